@@ -0,0 +1,56 @@
+TARGET = cryptos-bench
+
+QT -= gui
+CONFIG += c++11 link_pkgconfig warn_on
+QMAKE_CXXFLAGS += -Wall -Wextra -Werror -pedantic
+PKGCONFIG += sailfishcrypto sailfishsecrets sailfishcryptopluginapi nettle
+
+no_tracing: DEFINES += CRYPTOS_NO_TRACING
+
+INCLUDEPATH += ../src
+
+SOURCES += main.cpp \
+    benchmark.cpp \
+    ../src/requests.cpp \
+    ../src/signverifyrequests.cpp \
+    ../src/encryptdecryptrequests.cpp \
+    ../src/utils.cpp \
+    ../src/connections.cpp \
+    ../src/keycache.cpp \
+    ../src/metadatacache.cpp \
+    ../src/securearena.cpp \
+    ../src/mappedfile.cpp \
+    ../src/localplugins.cpp \
+    ../src/metrics.cpp \
+    ../src/trace.cpp \
+    ../src/kdfcalibration.cpp \
+    ../src/randompool.cpp \
+    ../src/generatekeyrequests.cpp \
+    ../src/createivrequests.cpp \
+    ../src/cipherdecipherrequests.cpp \
+    ../src/cipherpipeline.cpp \
+    ../src/digestrequests.cpp
+
+HEADERS += benchmark.h \
+    ../src/requests.h \
+    ../src/signverifyrequests.h \
+    ../src/encryptdecryptrequests.h \
+    ../src/utils.h \
+    ../src/connections.h \
+    ../src/keycache.h \
+    ../src/metadatacache.h \
+    ../src/byteview.h \
+    ../src/securearena.h \
+    ../src/mappedfile.h \
+    ../src/localplugins.h \
+    ../src/metrics.h \
+    ../src/trace.h \
+    ../src/kdfcalibration.h \
+    ../src/randompool.h \
+    ../src/asyncrequest.h \
+    ../src/batchrequest.h \
+    ../src/generatekeyrequests.h \
+    ../src/createivrequests.h \
+    ../src/cipherdecipherrequests.h \
+    ../src/cipherpipeline.h \
+    ../src/digestrequests.h
@@ -0,0 +1,88 @@
+#include "benchmark.h"
+
+#include <QtCore/QElapsedTimer>
+
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+namespace {
+
+    double Percentile(const std::vector<qint64>& sorted, const double percentile)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+
+        const std::size_t index =
+            std::min(sorted.size() - 1,
+                     static_cast<std::size_t>(percentile / 100 * sorted.size()));
+        return sorted[index] / 1e6;
+    }
+
+} // anonymous namespace
+
+BenchmarkResult RunBenchmark(const QString& operation,
+                             const QString& algorithm,
+                             const QString& plugin,
+                             const int payloadSize,
+                             const int iterations,
+                             const std::function<bool()>& call)
+{
+    BenchmarkResult result;
+    result.operation = operation;
+    result.algorithm = algorithm;
+    result.plugin = plugin;
+    result.payloadSize = payloadSize;
+    result.iterations = iterations;
+
+    std::vector<qint64> latencies;
+    latencies.reserve(iterations);
+
+    QElapsedTimer total;
+    total.start();
+
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+
+        bool succeeded = false;
+        try {
+            succeeded = call();
+        } catch (const std::exception&) {
+            succeeded = false;
+        }
+
+        if (succeeded) {
+            latencies.push_back(timer.nsecsElapsed());
+        } else {
+            ++result.errors;
+        }
+    }
+
+    const qint64 elapsed = total.nsecsElapsed();
+    std::sort(latencies.begin(), latencies.end());
+
+    result.opsPerSecond = elapsed > 0 ? latencies.size() * 1e9 / elapsed : 0;
+    result.p50 = Percentile(latencies, 50);
+    result.p95 = Percentile(latencies, 95);
+    result.p99 = Percentile(latencies, 99);
+
+    return result;
+}
+
+QJsonObject ToJson(const BenchmarkResult& result)
+{
+    QJsonObject object;
+    object.insert("operation", result.operation);
+    object.insert("algorithm", result.algorithm);
+    object.insert("plugin", result.plugin);
+    object.insert("payloadSize", result.payloadSize);
+    object.insert("iterations", result.iterations);
+    object.insert("errors", result.errors);
+    object.insert("opsPerSecond", result.opsPerSecond);
+    object.insert("p50", result.p50);
+    object.insert("p95", result.p95);
+    object.insert("p99", result.p99);
+    return object;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+
+#include <functional>
+
+struct BenchmarkResult {
+    QString operation;
+    QString algorithm;
+    QString plugin;
+    int payloadSize = 0;
+    int iterations = 0;
+    int errors = 0;
+    double opsPerSecond = 0;
+    double p50 = 0; // milliseconds
+    double p95 = 0; // milliseconds
+    double p99 = 0; // milliseconds
+};
+
+/*
+  Calls operation iterations times and measures latency of every call.
+  Operation returns false on error, failed calls are counted but not measured.
+ */
+BenchmarkResult RunBenchmark(const QString& operation,
+                             const QString& algorithm,
+                             const QString& plugin,
+                             const int payloadSize,
+                             const int iterations,
+                             const std::function<bool()>& call);
+
+QJsonObject ToJson(const BenchmarkResult& result);
@@ -0,0 +1,452 @@
+#include "benchmark.h"
+
+#include "requests.h"
+#include "signverifyrequests.h"
+#include "encryptdecryptrequests.h"
+#include "generatekeyrequests.h"
+#include "createivrequests.h"
+#include "cipherdecipherrequests.h"
+#include "cipherpipeline.h"
+#include "digestrequests.h"
+#include "randompool.h"
+#include "trace.h"
+
+#include <Sailfish/Crypto/cryptomanager.h>
+
+#include <QtCore/QBuffer>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+
+#include <memory>
+#include <vector>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    const QString COLLECTION_NAME = QStringLiteral("ExampleCollection");
+    const QString DB_NAME = QStringLiteral("org.sailfishos.secrets.plugin.storage.sqlite");
+    const QString GOST_PLUGIN_NAME = QStringLiteral("org.sailfishos.plugin.encryption.gost");
+
+    constexpr int MAX_WINDOW_SIZE = 16;
+
+    struct Settings {
+        int iterations;
+        QList<int> payloadSizes;
+        bool gost;
+    };
+
+    QByteArray CreatePayload(const int size)
+    {
+        QByteArray result(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            result[i] = static_cast<char>(qrand());
+        }
+        return result;
+    }
+
+    // Block modes without padding require whole blocks.
+    int AlignToBlock(const int size, const int blockSize)
+    {
+        return qMax(blockSize, size / blockSize * blockSize);
+    }
+
+    /*
+      Fresh IVs for every encryption of a benchmark, so the same IV is never used twice
+      with the same key (fatal for GCM). The IV size is taken from the plugin once, the
+      IVs themselves come from the random pool outside of the measured calls.
+     */
+    QVector<QByteArray> CreateIVs(const Key& key,
+                                  const CryptoManager::BlockMode blockMode,
+                                  const QString& pluginName,
+                                  const int count)
+    {
+        const int ivSize = CreateIVRequests::createIV(
+            key.algorithm(), blockMode, key.size(), pluginName).size();
+
+        QVector<QByteArray> ivs;
+        ivs.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            ivs.append(RandomPool::threadPool()->takeBytes(ivSize));
+        }
+        return ivs;
+    }
+
+    Key CreateStoredKey(const QString& name,
+                        const CryptoManager::Algorithm algorithm,
+                        const CryptoManager::Operations operations,
+                        const CryptoManager::DigestFunction digestFunction,
+                        const std::size_t keyLength,
+                        const QString& pluginName)
+    {
+        Requests::deleteStoredKey(name, COLLECTION_NAME, DB_NAME);
+        return GenerateKeyRequests::createStoredKey(
+            name, COLLECTION_NAME, DB_NAME,
+            algorithm, operations, digestFunction, keyLength, pluginName);
+    }
+
+    void BenchSignVerify(const Settings& settings,
+                         const QString& algorithmName,
+                         const CryptoManager::Algorithm algorithm,
+                         const CryptoManager::DigestFunction digestFunction,
+                         const std::size_t keyLength,
+                         const QString& pluginName,
+                         QJsonArray* results)
+    {
+        const QString keyName = "BenchSignKey" + algorithmName;
+        const Key key = CreateStoredKey(
+            keyName, algorithm,
+            CryptoManager::OperationSign | CryptoManager::OperationVerify,
+            digestFunction, keyLength, pluginName);
+        const auto padding = CryptoManager::SignaturePaddingNone;
+
+        for (const int size : settings.payloadSizes) {
+            const QByteArray data = CreatePayload(size);
+            const QByteArray signature =
+                SignVerifyRequests::sign(key, data, pluginName, padding, digestFunction);
+
+            results->append(ToJson(RunBenchmark(
+                "sign", algorithmName, pluginName, size, settings.iterations, [&] () {
+                    return not SignVerifyRequests::sign(
+                        key, data, pluginName, padding, digestFunction).isEmpty();
+                })));
+
+            results->append(ToJson(RunBenchmark(
+                "verify", algorithmName, pluginName, size, settings.iterations, [&] () {
+                    return SignVerifyRequests::verify(
+                        key, data, signature, pluginName, padding, digestFunction);
+                })));
+        }
+
+        Requests::deleteStoredKey(keyName, COLLECTION_NAME, DB_NAME);
+    }
+
+    void BenchEncryptDecrypt(const Settings& settings,
+                             const QString& algorithmName,
+                             const Key& key,
+                             const CryptoManager::BlockMode blockMode,
+                             const int blockSize,
+                             const QByteArray& authCode,
+                             const QString& pluginName,
+                             QJsonArray* results)
+    {
+        const EncryptDecryptRequests requests;
+        const auto padding = CryptoManager::EncryptionPaddingNone;
+        const QByteArray iv = CreateIVRequests::createIV(
+            key.algorithm(), blockMode, key.size(), pluginName);
+
+        for (const int requestedSize : settings.payloadSizes) {
+            const int size = AlignToBlock(requestedSize, blockSize);
+            const QByteArray data = CreatePayload(size);
+            QByteArray authTag;
+            const QByteArray encrypted = requests.encrypt(
+                key, iv, data, blockMode, padding, pluginName, authCode, &authTag);
+
+            const QVector<QByteArray> ivs = CreateIVs(key, blockMode, pluginName, settings.iterations);
+            int nextIV = 0;
+            results->append(ToJson(RunBenchmark(
+                "encrypt", algorithmName, pluginName, size, settings.iterations, [&] () {
+                    QByteArray tag;
+                    return not requests.encrypt(
+                        key, ivs.at(nextIV++), data, blockMode, padding, pluginName,
+                        authCode, &tag).isEmpty();
+                })));
+
+            results->append(ToJson(RunBenchmark(
+                "decrypt", algorithmName, pluginName, size, settings.iterations, [&] () {
+                    QByteArray tag = authTag;
+                    return requests.decrypt(
+                        key, iv, encrypted, blockMode, padding, pluginName, authCode, &tag) == data;
+                })));
+        }
+    }
+
+    void BenchCipherSession(const Settings& settings,
+                            const Key& key,
+                            QJsonArray* results)
+    {
+        const auto blockMode = CryptoManager::BlockModeCbc;
+        const auto padding = CryptoManager::EncryptionPaddingNone;
+        const auto signaturePadding = CryptoManager::SignaturePaddingNone;
+        const QString pluginName = CryptoManager::DefaultCryptoPluginName;
+        const QByteArray iv = CreateIVRequests::createIV(
+            key.algorithm(), blockMode, key.size(), pluginName);
+
+        for (const int requestedSize : settings.payloadSizes) {
+            const int size = AlignToBlock(requestedSize, 16);
+            const QByteArray data = CreatePayload(size);
+            const QByteArray encrypted = CipherDecipherRequests::cipherText(
+                key, iv, data, blockMode, padding, signaturePadding);
+
+            const QVector<QByteArray> ivs = CreateIVs(key, blockMode, pluginName, settings.iterations);
+            int nextIV = 0;
+            results->append(ToJson(RunBenchmark(
+                "cipher", "AES-256-CBC", pluginName, size, settings.iterations, [&] () {
+                    return not CipherDecipherRequests::cipherText(
+                        key, ivs.at(nextIV++), data, blockMode, padding, signaturePadding).isEmpty();
+                })));
+
+            results->append(ToJson(RunBenchmark(
+                "decipher", "AES-256-CBC", pluginName, size, settings.iterations, [&] () {
+                    return CipherDecipherRequests::decipherText(
+                        key, iv, encrypted, blockMode, padding, signaturePadding) == data;
+                })));
+        }
+    }
+
+    /*
+      Encrypts MAX_WINDOW_SIZE payloads through CipherPipeline with window sizes from
+      1 to MAX_WINDOW_SIZE, one operation is the whole set of sessions.
+     */
+    void BenchCipherPipeline(const Settings& settings,
+                             const Key& key,
+                             QJsonArray* results)
+    {
+        const QString pluginName = CryptoManager::DefaultCryptoPluginName;
+
+        for (const int requestedSize : settings.payloadSizes) {
+            const int size = AlignToBlock(requestedSize, 16);
+            QVector<QByteArray> payloads;
+            for (int i = 0; i < MAX_WINDOW_SIZE; ++i) {
+                payloads.append(CreatePayload(size));
+            }
+
+            for (int windowSize = 1; windowSize <= MAX_WINDOW_SIZE; ++windowSize) {
+                const QVector<QByteArray> ivs = CreateIVs(
+                    key, CryptoManager::BlockModeCbc, pluginName,
+                    settings.iterations * MAX_WINDOW_SIZE);
+                int nextIV = 0;
+                const auto call = [&] () {
+                    std::vector<std::unique_ptr<QBuffer>> buffers;
+                    CipherPipeline pipeline(windowSize);
+
+                    for (const auto& payload : payloads) {
+                        buffers.emplace_back(new QBuffer);
+                        buffers.back()->setData(payload);
+                        buffers.back()->open(QIODevice::ReadOnly);
+                        QBuffer* const input = buffers.back().get();
+
+                        buffers.emplace_back(new QBuffer);
+                        buffers.back()->open(QIODevice::WriteOnly);
+                        QBuffer* const output = buffers.back().get();
+
+                        CipherPipeline::Job job;
+                        job.operation = CryptoManager::OperationEncrypt;
+                        job.key = key;
+                        job.iv = ivs.at(nextIV++);
+                        job.input = input;
+                        job.output = output;
+                        job.blockMode = CryptoManager::BlockModeCbc;
+                        job.padding = CryptoManager::EncryptionPaddingNone;
+                        job.signaturePadding = CryptoManager::SignaturePaddingNone;
+                        pipeline.addJob(job);
+                    }
+
+                    return pipeline.run();
+                };
+
+                results->append(ToJson(RunBenchmark(
+                    QStringLiteral("cipher_pipeline_w%1").arg(windowSize),
+                    "AES-256-CBC", pluginName, size * MAX_WINDOW_SIZE,
+                    settings.iterations, call)));
+            }
+        }
+    }
+
+    void BenchDigest(const Settings& settings,
+                     const QString& algorithmName,
+                     const CryptoManager::DigestFunction digestFunction,
+                     const QString& pluginName,
+                     QJsonArray* results)
+    {
+        for (const int size : settings.payloadSizes) {
+            const QByteArray data = CreatePayload(size);
+
+            results->append(ToJson(RunBenchmark(
+                "digest", algorithmName, pluginName, size, settings.iterations, [&] () {
+                    return not DigestRequests::digest(
+                        data, CryptoManager::SignaturePaddingNone, digestFunction, pluginName).isEmpty();
+                })));
+        }
+    }
+
+    void BenchCreateIV(const Settings& settings,
+                       const QString& algorithmName,
+                       const CryptoManager::Algorithm algorithm,
+                       const CryptoManager::BlockMode blockMode,
+                       const std::size_t keyLength,
+                       const QString& pluginName,
+                       QJsonArray* results)
+    {
+        results->append(ToJson(RunBenchmark(
+            "create_iv", algorithmName, pluginName, 0, settings.iterations, [&] () {
+                return not CreateIVRequests::createIV(
+                    algorithm, blockMode, keyLength, pluginName).isEmpty();
+            })));
+    }
+
+    void BenchCreateKey(const Settings& settings,
+                        const QString& algorithmName,
+                        const CryptoManager::Algorithm algorithm,
+                        const CryptoManager::Operations operations,
+                        const CryptoManager::DigestFunction digestFunction,
+                        const std::size_t keyLength,
+                        const QString& pluginName,
+                        QJsonArray* results)
+    {
+        // Key pair generation is slow, so it is measured fewer times.
+        const int iterations = qMax(1, settings.iterations / 10);
+
+        results->append(ToJson(RunBenchmark(
+            "create_key", algorithmName, pluginName, 0, iterations, [&] () {
+                GenerateKeyRequests::createKey(
+                    algorithm, operations, digestFunction, keyLength, pluginName);
+                return true;
+            })));
+    }
+
+    void RunSuite(const Settings& settings, QJsonArray* results)
+    {
+        const QString defaultPlugin = CryptoManager::DefaultCryptoPluginName;
+        const auto encryptDecrypt = CryptoManager::OperationEncrypt | CryptoManager::OperationDecrypt;
+        const auto signVerify = CryptoManager::OperationSign | CryptoManager::OperationVerify;
+
+        BenchSignVerify(settings, "RSA-2048", CryptoManager::AlgorithmRsa,
+                        CryptoManager::DigestSha512, 2048, defaultPlugin, results);
+
+        const Key aesKey = CreateStoredKey(
+            "BenchAesKey", CryptoManager::AlgorithmAes, encryptDecrypt,
+            CryptoManager::DigestSha512, 256, defaultPlugin);
+
+        BenchEncryptDecrypt(settings, "AES-256-CBC", aesKey, CryptoManager::BlockModeCbc,
+                            16, QByteArray(), defaultPlugin, results);
+        BenchEncryptDecrypt(settings, "AES-256-GCM", aesKey, CryptoManager::BlockModeGcm,
+                            1, QByteArray("bench_auth_code"), defaultPlugin, results);
+        BenchEncryptDecrypt(settings, "AES-256-OFB", aesKey, CryptoManager::BlockModeOfb,
+                            1, QByteArray(), defaultPlugin, results);
+        BenchCipherSession(settings, aesKey, results);
+        BenchCipherPipeline(settings, aesKey, results);
+
+        BenchDigest(settings, "SHA-512", CryptoManager::DigestSha512, defaultPlugin, results);
+        BenchCreateIV(settings, "AES-256-CBC", CryptoManager::AlgorithmAes,
+                      CryptoManager::BlockModeCbc, 256, defaultPlugin, results);
+        BenchCreateKey(settings, "AES-256", CryptoManager::AlgorithmAes, encryptDecrypt,
+                       CryptoManager::DigestSha512, 256, defaultPlugin, results);
+        BenchCreateKey(settings, "RSA-2048", CryptoManager::AlgorithmRsa, signVerify,
+                       CryptoManager::DigestSha512, 2048, defaultPlugin, results);
+
+        Requests::deleteStoredKey("BenchAesKey", COLLECTION_NAME, DB_NAME);
+
+        if (not settings.gost) {
+            return;
+        }
+
+        BenchSignVerify(settings, "GOST-2012-256", CryptoManager::AlgorithmGost,
+                        CryptoManager::DigestGost_2012_256, 256, GOST_PLUGIN_NAME, results);
+
+        const Key gostKey = CreateStoredKey(
+            "BenchGostKey", CryptoManager::AlgorithmGost, encryptDecrypt,
+            CryptoManager::DigestGost_2012_256, 256, GOST_PLUGIN_NAME);
+
+        BenchEncryptDecrypt(settings, "GOST-OFB", gostKey, CryptoManager::BlockModeOfb,
+                            1, QByteArray(), GOST_PLUGIN_NAME, results);
+        BenchDigest(settings, "GOST-2012-256", CryptoManager::DigestGost_2012_256,
+                    GOST_PLUGIN_NAME, results);
+        BenchCreateIV(settings, "GOST-OFB", CryptoManager::AlgorithmGost,
+                      CryptoManager::BlockModeOfb, 256, GOST_PLUGIN_NAME, results);
+        BenchCreateKey(settings, "GOST-256", CryptoManager::AlgorithmGost, signVerify,
+                       CryptoManager::DigestGost_2012_256, 256, GOST_PLUGIN_NAME, results);
+
+        Requests::deleteStoredKey("BenchGostKey", COLLECTION_NAME, DB_NAME);
+    }
+
+    /*
+      The random pool of the main thread must go before the application object.
+     */
+    struct ThreadPoolRelease {
+        ~ThreadPoolRelease()
+        {
+            RandomPool::releaseThreadPool();
+        }
+    };
+
+} // anonymous namespace
+
+/*
+  Benchmark suite for all request wrappers.
+  Reports ops/sec and p50/p95/p99 latency for every operation, algorithm, plugin and
+  payload size as JSON, so results of different releases can be compared.
+ */
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    const ThreadPoolRelease threadPoolRelease;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"iterations", "Number of calls of every operation.", "count", "100"});
+    parser.addOption({"sizes", "Comma separated payload sizes in bytes.", "bytes",
+                      "64,1024,16384,262144"});
+    parser.addOption({"no-gost", "Do not measure org.sailfishos.plugin.encryption.gost."});
+    parser.addOption({"output", "Write JSON results to the file instead of stdout.", "file"});
+    parser.addOption({"trace", "Write Chrome trace of all calls to the file.", "file"});
+    parser.process(app);
+
+    Settings settings;
+    settings.iterations = parser.value("iterations").toInt();
+    settings.gost = not parser.isSet("no-gost");
+    for (const QString& size : parser.value("sizes").split(',', QString::SkipEmptyParts)) {
+        if (size.toInt() > 0) {
+            settings.payloadSizes.append(size.toInt());
+        }
+    }
+
+    if (settings.iterations <= 0 or settings.payloadSizes.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    if (not Requests::isCollectionExists() and not Requests::createCollection()) {
+        qDebug() << "Can't create collection";
+        return 1;
+    }
+
+    Trace::setEnabled(parser.isSet("trace"));
+
+    QJsonArray results;
+    try {
+        RunSuite(settings, &results);
+    } catch (const std::exception& e) {
+        qDebug() << e.what();
+        return 1;
+    }
+
+    if (parser.isSet("trace") and not Trace::writeChromeTrace(parser.value("trace"))) {
+        qDebug() << "Can't write trace" << parser.value("trace");
+        return 1;
+    }
+
+    QJsonObject report;
+    report.insert("version", 1);
+    report.insert("iterations", settings.iterations);
+    report.insert("results", results);
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    QFile output;
+    if (parser.isSet("output")) {
+        output.setFileName(parser.value("output"));
+        if (not output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qDebug() << "Can't open" << output.fileName() << output.errorString();
+            return 1;
+        }
+    } else if (not output.open(stdout, QIODevice::WriteOnly)) {
+        return 1;
+    }
+
+    output.write(json);
+
+    return 0;
+}
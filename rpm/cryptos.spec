@@ -8,6 +8,8 @@ Requires(post): /sbin/ldconfig
 Requires(postun): /sbin/ldconfig
 Requires: libsailfishsecrets
 BuildRequires: libsailfishsecrets-devel
+BuildRequires: pkgconfig(sailfishcryptopluginapi)
+BuildRequires: pkgconfig(nettle)
 
 Summary: Various requests to sailfish api
 
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "utils.h"
+
+#include <QtCore/QException>
+#include <QtCore/QFuture>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QObject>
+
+/*
+  Error which is stored in a future when an asynchronous request was failed.
+  Calling QFuture::result() on such future rethrows it.
+ */
+class RequestError : public QException {
+public:
+    explicit RequestError(const char* message)
+        : m_message(message)
+    {
+    }
+
+    void raise() const override { throw *this; }
+    RequestError* clone() const override { return new RequestError(*this); }
+    const char* what() const noexcept override { return m_message; }
+
+private:
+    const char* m_message;
+};
+
+/*
+  Starts already configured request without waiting for it and returns a future
+  which is finished when the request status becomes Finished.
+  The request must be allocated on the heap, it is deleted after finishing.
+  On success the future contains extract(request). On failure the future contains
+  RequestError(errorMessage) or, if errorMessage is nullptr, a default constructed
+  result, the same as the synchronous wrappers which do not throw. A request which
+  finished successfully is still failed if accept(request) returns false, e.g. when
+  the authentication tag is not verified.
+  The calling thread must run an event loop.
+ */
+template <typename Result, typename Request, typename Accept, typename Extract>
+QFuture<Result> StartAsyncRequest(Request* const request,
+                                  Accept accept,
+                                  Extract extract,
+                                  const char* const errorMessage)
+{
+    QFutureInterface<Result> promise;
+    promise.reportStarted();
+
+    QObject::connect(request, &Request::statusChanged, request,
+                     [request, promise, accept, extract, errorMessage] () mutable {
+        if (request->status() != Request::Finished) {
+            return;
+        }
+
+        if (IsRequestWasSuccessful(request) and accept(*request)) {
+            promise.reportResult(extract(*request));
+        } else if (errorMessage) {
+            promise.reportException(RequestError(errorMessage));
+        } else {
+            promise.reportResult(Result());
+        }
+
+        promise.reportFinished();
+        request->deleteLater();
+    });
+
+    request->startRequest();
+
+    return promise.future();
+}
+
+template <typename Result, typename Request, typename Extract>
+QFuture<Result> StartAsyncRequest(Request* const request,
+                                  Extract extract,
+                                  const char* const errorMessage)
+{
+    return StartAsyncRequest<Result>(
+        request,
+        [] (const Request&) { return true; },
+        extract,
+        errorMessage);
+}
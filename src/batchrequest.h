@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QEventLoop>
+#include <QtCore/QObject>
+
+#include <functional>
+
+/*
+  Runs count requests keeping at most windowSize of them in flight and blocks until
+  all of them are finished.
+  create(index) must return a configured request allocated on the heap, it is
+  started here and deleted after finish(index, request) was called for it.
+  Requests are finished in arbitrary order, so finish must store the result by index.
+ */
+template <typename Request, typename Create, typename Finish>
+void RunRequestBatch(const int count,
+                     const int windowSize,
+                     Create create,
+                     Finish finish)
+{
+    const int window = qMax(windowSize, 1);
+    QEventLoop loop;
+    int next = 0;
+    int active = 0;
+
+    std::function<void()> startNext;
+    startNext = [&] () {
+        const int index = next++;
+        Request* const request = create(index);
+        ++active;
+
+        QObject::connect(request, &Request::statusChanged, &loop, [&, request, index] () {
+            if (request->status() != Request::Finished) {
+                return;
+            }
+
+            finish(index, *request);
+            request->deleteLater();
+            --active;
+
+            while (active < window and next < count) {
+                startNext();
+            }
+
+            if (active == 0) {
+                loop.quit();
+            }
+        }, Qt::QueuedConnection);
+
+        request->startRequest();
+    };
+
+    while (active < window and next < count) {
+        startNext();
+    }
+
+    if (active > 0) {
+        loop.exec();
+    }
+}
+
+/*
+  Stored keys are referenced by identifier only, so the key data is not serialized
+  with every request of a batch.
+ */
+inline Sailfish::Crypto::Key CreateBatchKey(const Sailfish::Crypto::Key& key)
+{
+    if (key.name().isEmpty()) {
+        return key;
+    }
+
+    return Sailfish::Crypto::Key(key.name(), key.collectionName(), key.storagePluginName());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtCore/QByteArray>
+
+#include <cstring>
+
+/*
+  Non-owning view of the caller's memory, it is passed to requests without copying.
+  The memory must stay valid and unchanged until the call which takes the view returns.
+ */
+class ByteView {
+public:
+    ByteView(const char* data, const int size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    ByteView(const QByteArray& data)
+        : m_data(data.constData())
+        , m_size(data.size())
+    {
+    }
+
+    const char* data() const { return m_data; }
+    int size() const { return m_size; }
+
+    /*
+      QByteArray which refers to the viewed memory instead of owning a copy of it.
+     */
+    QByteArray toRawByteArray() const
+    {
+        return QByteArray::fromRawData(m_data, m_size);
+    }
+
+    ByteView mid(const int position, const int length) const
+    {
+        return ByteView(m_data + position, qMin(length, m_size - position));
+    }
+
+private:
+    const char* m_data;
+    int m_size;
+};
+
+/*
+  Empties the reusable output buffer keeping its memory, so filling it again up to
+  capacity bytes does not allocate.
+ */
+inline void ResetOutputBuffer(QByteArray* buffer, const int capacity)
+{
+    buffer->reserve(qMax(buffer->capacity(), capacity));
+    buffer->resize(0);
+}
+
+/*
+  Copies data into the reusable output buffer when it fits into the memory the buffer
+  already owns alone, so a steady-state loop does not allocate for the output.
+  Otherwise the buffer takes over data without copying, and keeps that memory for the
+  next call.
+ */
+inline void AssignToOutputBuffer(QByteArray* buffer, const QByteArray& data)
+{
+    if (buffer->isDetached() and buffer->capacity() >= data.size()) {
+        buffer->resize(data.size());
+        std::memcpy(buffer->data(), data.constData(), data.size());
+    } else {
+        *buffer = data;
+    }
+}
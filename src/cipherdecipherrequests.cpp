@@ -1,67 +1,375 @@
 #include "cipherdecipherrequests.h"
+#include "byteview.h"
+#include "securearena.h"
 #include "utils.h"
+#include "connections.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/cipherrequest.h>
 
 #include <QtCore/QDebug>
+#include <QtCore/QIODevice>
+
+#include <climits>
+#include <functional>
 
 using namespace Sailfish::Crypto;
 
-QByteArray CipherDecipherRequests::cipherText(
-    const Sailfish::Crypto::Key& key,
-    const QByteArray& iv,
-    const QByteArray& plainText,
-    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
-    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
-    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding)
-{
-    qDebug() << Q_FUNC_INFO;
-
-    QByteArray ciphertext;
-
-    CryptoManager manager;
-    CipherRequest request;
-    request.setManager(&manager);
-    request.setCipherMode(CipherRequest::InitializeCipher);
-    request.setKey(key);
-    request.setBlockMode(blockMode);
-    request.setEncryptionPadding(padding);
-    request.setSignaturePadding(signaturePadding);
-    request.setOperation(Sailfish::Crypto::CryptoManager::OperationEncrypt);
-    request.setInitializationVector(iv);
-    request.setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
-    request.startRequest();
-    request.waitForFinished();
-
-    if (not IsRequestWasSuccessful(&request)) {
-        return {};
+namespace {
+
+    /*
+      Input of a cipher session. read() returns the next chunk, it must not be called
+      when atEnd() is true.
+     */
+    struct ChunkSource {
+        std::function<bool()> atEnd;
+        std::function<bool(QByteArray* chunk)> read;
+    };
+
+    using ChunkSink = std::function<bool(const QByteArray& data)>;
+
+    /*
+      Authenticated encryption parameters of a cipher session. authCode is sent before
+      the data. When deciphering, authTag is verified on finalization, when ciphering
+      the generated tag is stored to generatedTag. Both are required with BlockModeGcm.
+     */
+    struct SessionAuthentication {
+        QByteArray authCode;
+        QByteArray authTag;
+        QByteArray* generatedTag;
+    };
+
+    SessionAuthentication CipherAuthentication(const QByteArray& authCode, QByteArray* authTag)
+    {
+        return {authCode, QByteArray(), authTag};
+    }
+
+    SessionAuthentication DecipherAuthentication(const QByteArray& authCode, const QByteArray& authTag)
+    {
+        return {authCode, authTag, nullptr};
+    }
+
+    bool WriteGeneratedData(const CipherRequest& request, const ChunkSink& output, qint64* written)
+    {
+        const QByteArray data = request.generatedData();
+        if (data.isEmpty()) {
+            return true;
+        }
+
+        if (not output(data)) {
+            return false;
+        }
+
+        *written += data.size();
+        return true;
     }
 
-    // Update the cipher session with data to encrypt.
-    for (int i = 0; i < plainText.size(); ++i) {
-        request.setCipherMode(CipherRequest::UpdateCipher);
-        request.setData(QByteArray(1, plainText[i]));
+    /*
+      Cipher session which sends every input chunk with one UpdateCipher request.
+      Generated data is written to the output as soon as it arrives, so memory
+      consumption is bounded by the chunk size.
+     */
+    bool RunCipherSession(
+        const CryptoManager::Operation operation,
+        const Key& key,
+        const QByteArray& iv,
+        const SessionAuthentication& authentication,
+        const ChunkSource& input,
+        const ChunkSink& output,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const CryptoManager::SignaturePadding signaturePadding)
+    {
+        MetricsScope metrics(operation == CryptoManager::OperationEncrypt ? "cipher" : "decipher",
+                             Metrics::algorithmName(key.algorithm()),
+                             CryptoManager::DefaultCryptoPluginName);
+        qint64 written = 0;
+
+        // Without a tag GCM deciphering would not be authenticated at all.
+        const bool authenticated = blockMode == CryptoManager::BlockModeGcm;
+        const bool decrypt = operation == CryptoManager::OperationDecrypt;
+        if (authenticated and (decrypt ? authentication.authTag.isEmpty()
+                                       : not authentication.generatedTag)) {
+            qDebug() << "Error when starting cipher session: authentication tag is required";
+            return false;
+        }
+
+        TraceScope trace("cipher session");
+        trace.phase("initialize");
+
+        CipherRequest request;
+        request.setManager(Connections::cryptoManager());
+        request.setCipherMode(CipherRequest::InitializeCipher);
+        request.setKey(key);
+        request.setBlockMode(blockMode);
+        request.setEncryptionPadding(padding);
+        request.setSignaturePadding(signaturePadding);
+        request.setOperation(operation);
+        request.setInitializationVector(iv);
+        request.setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
         request.startRequest();
         request.waitForFinished();
 
         if (not IsRequestWasSuccessful(&request)) {
-            return {};
+            return false;
+        }
+
+        // Additional authenticated data must precede the data.
+        if (not authentication.authCode.isEmpty()) {
+            trace.phase("authenticate");
+            request.setCipherMode(CipherRequest::UpdateCipherAuthentication);
+            request.setData(authentication.authCode);
+            request.startRequest();
+            request.waitForFinished();
+
+            if (not IsRequestWasSuccessful(&request)) {
+                return false;
+            }
+        }
+
+        // Update the cipher session with data by chunks.
+        while (not input.atEnd()) {
+            trace.phase("read");
+            QByteArray chunk;
+            if (not input.read(&chunk)) {
+                return false;
+            }
+
+            metrics.addBytesIn(chunk.size());
+
+            request.setCipherMode(CipherRequest::UpdateCipher);
+            request.setData(chunk);
+            trace.phase("update");
+            request.startRequest();
+            request.waitForFinished();
+
+            trace.phase("write");
+            if (not IsRequestWasSuccessful(&request) or
+                not WriteGeneratedData(request, output, &written)) {
+                return false;
+            }
+        }
+
+        // The tag to verify is sent with the finalization.
+        const bool verifyTag = authenticated and decrypt;
+
+        trace.phase("finalize");
+        request.setCipherMode(CipherRequest::FinalizeCipher);
+        request.setData(verifyTag ? authentication.authTag : QByteArray());
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            return false;
+        }
+
+        if (verifyTag and request.verificationStatus() != CryptoManager::VerificationSucceeded) {
+            qDebug() << "Error when finalizing cipher session: authentication tag verification failed";
+            return false;
+        }
+
+        if (authenticated and not decrypt) {
+            *authentication.generatedTag = request.generatedData();
+        } else if (not WriteGeneratedData(request, output, &written)) {
+            return false;
+        }
+
+        metrics.setSucceeded(written);
+        return true;
+    }
+
+    bool RunCipherSession(
+        const CryptoManager::Operation operation,
+        const Key& key,
+        const QByteArray& iv,
+        const SessionAuthentication& authentication,
+        QIODevice* input,
+        QIODevice* output,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize)
+    {
+        if (not input or not input->isReadable() or
+            not output or not output->isWritable() or
+            chunkSize <= 0) {
+            qDebug() << "Error when starting cipher session: bad arguments";
+            return false;
+        }
+
+        ChunkSource source;
+        source.atEnd = [input] () {
+            return input->atEnd();
+        };
+        source.read = [input, chunkSize] (QByteArray* chunk) {
+            *chunk = input->read(chunkSize);
+            if (chunk->isEmpty()) {
+                qDebug() << "Error when reading cipher input:" << input->errorString();
+                return false;
+            }
+            return true;
+        };
+
+        const ChunkSink sink = [output] (const QByteArray& data) {
+            if (output->write(data) != data.size()) {
+                qDebug() << "Error when writing cipher output:" << output->errorString();
+                return false;
+            }
+            return true;
+        };
+
+        return RunCipherSession(operation, key, iv, authentication, source, sink,
+                                blockMode, padding, signaturePadding);
+    }
+
+    /*
+      Chunks refer to the input memory and the output is appended to the caller's
+      buffer, so the client side copies nothing but the generated data.
+     */
+    bool RunCipherSession(
+        const CryptoManager::Operation operation,
+        const Key& key,
+        const QByteArray& iv,
+        const SessionAuthentication& authentication,
+        const ByteView& data,
+        QByteArray* output,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize)
+    {
+        if (not output or chunkSize <= 0) {
+            qDebug() << "Error when starting cipher session: bad arguments";
+            return false;
+        }
+
+        // Padding and authentication tags add at most two blocks of data.
+        ResetOutputBuffer(output, data.size() + 2 * qMax(iv.size(), 16));
+
+        int offset = 0;
+        ChunkSource source;
+        source.atEnd = [&data, &offset] () {
+            return offset >= data.size();
+        };
+        source.read = [&data, &offset, chunkSize] (QByteArray* chunk) {
+            const ByteView view = data.mid(offset, static_cast<int>(qMin<qint64>(chunkSize, INT_MAX)));
+            offset += view.size();
+            *chunk = view.toRawByteArray();
+            return true;
+        };
+
+        const ChunkSink sink = [output] (const QByteArray& generated) {
+            output->append(generated);
+            return true;
+        };
+
+        // Deciphered data must not be used if the tag is not verified.
+        if (not RunCipherSession(operation, key, iv, authentication, source, sink,
+                                 blockMode, padding, signaturePadding)) {
+            output->resize(0);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool RunCipherSession(
+        const CryptoManager::Operation operation,
+        const Key& key,
+        const QByteArray& iv,
+        const SessionAuthentication& authentication,
+        const ByteView& data,
+        SecureBuffer* output,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize)
+    {
+        if (not output or chunkSize <= 0) {
+            qDebug() << "Error when starting cipher session: bad arguments";
+            return false;
+        }
+
+        output->clear();
+        output->reserve(data.size() + 2 * qMax(iv.size(), 16));
+
+        int offset = 0;
+        ChunkSource source;
+        source.atEnd = [&data, &offset] () {
+            return offset >= data.size();
+        };
+        source.read = [&data, &offset, chunkSize] (QByteArray* chunk) {
+            const ByteView view = data.mid(offset, static_cast<int>(qMin<qint64>(chunkSize, INT_MAX)));
+            offset += view.size();
+            *chunk = view.toRawByteArray();
+            return true;
+        };
+
+        // generated shares its storage with the generated data of the request, so wiping
+        // it leaves the plain text of the chunk only in the buffer. Copies made by the
+        // daemon client library and D-Bus are out of reach, as are the IV and the tag,
+        // which are not secret.
+        const ChunkSink sink = [output] (const QByteArray& generated) {
+            output->append(ByteView(generated));
+            SecureWipe(const_cast<char*>(generated.constData()), generated.size());
+            return true;
+        };
+
+        if (not RunCipherSession(operation, key, iv, authentication, source, sink,
+                                 blockMode, padding, signaturePadding)) {
+            output->clear();
+            return false;
         }
 
-        ciphertext.append(request.generatedData());
+        return true;
     }
 
-    request.setCipherMode(CipherRequest::FinalizeCipher);
-    request.startRequest();
-    request.waitForFinished();
+    QByteArray RunCipherSession(
+        const CryptoManager::Operation operation,
+        const Key& key,
+        const QByteArray& iv,
+        const SessionAuthentication& authentication,
+        const QByteArray& data,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize)
+    {
+        QByteArray result;
+        if (not RunCipherSession(operation, key, iv, authentication, ByteView(data), &result,
+                                 blockMode, padding, signaturePadding, chunkSize)) {
+            return {};
+        }
 
-    if (not IsRequestWasSuccessful(&request)) {
-        return {};
+        return result;
     }
 
-    ciphertext.append(request.generatedData());
+} // anonymous namespace
+
+QByteArray CipherDecipherRequests::cipherText(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const QByteArray& plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    QByteArray* authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
 
-    return ciphertext;
+    return RunCipherSession(
+        CryptoManager::OperationEncrypt,
+        key,
+        iv,
+        CipherAuthentication(authCode, authTag),
+        plainText,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
 }
 
 QByteArray CipherDecipherRequests::decipherText(
@@ -70,53 +378,156 @@ QByteArray CipherDecipherRequests::decipherText(
     const QByteArray& ciphertext,
     const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
     const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
-    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding)
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    const QByteArray& authTag)
 {
-    qDebug() << Q_FUNC_INFO;
-
-    QByteArray plaintext;
-
-    CryptoManager manager;
-    CipherRequest request;
-    request.setManager(&manager);
-    request.setCipherMode(CipherRequest::InitializeCipher);
-    request.setKey(key);
-    request.setBlockMode(blockMode);
-    request.setEncryptionPadding(padding);
-    request.setSignaturePadding(signaturePadding);
-    request.setOperation(Sailfish::Crypto::CryptoManager::OperationDecrypt);
-    request.setInitializationVector(iv);
-    request.setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
-    request.startRequest();
-    request.waitForFinished();
-
-    if (not IsRequestWasSuccessful(&request)) {
-        return {};
-    }
+    TraceScope trace(Q_FUNC_INFO);
 
-    // Update the cipher session with data to encrypt.
-    for (int i = 0; i < ciphertext.size(); ++i) {
-        request.setCipherMode(CipherRequest::UpdateCipher);
-        request.setData(QByteArray(1, ciphertext[i]));
-        request.startRequest();
-        request.waitForFinished();
+    return RunCipherSession(
+        CryptoManager::OperationDecrypt,
+        key,
+        iv,
+        DecipherAuthentication(authCode, authTag),
+        ciphertext,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
+}
 
-        if (not IsRequestWasSuccessful(&request)) {
-            return {};
-        }
+bool CipherDecipherRequests::cipherStream(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    QIODevice* input,
+    QIODevice* output,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    QByteArray* authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
 
-        plaintext.append(request.generatedData());
-    }
+    return RunCipherSession(
+        CryptoManager::OperationEncrypt,
+        key,
+        iv,
+        CipherAuthentication(authCode, authTag),
+        input,
+        output,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
+}
 
-    request.setCipherMode(CipherRequest::FinalizeCipher);
-    request.startRequest();
-    request.waitForFinished();
+bool CipherDecipherRequests::decipherStream(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    QIODevice* input,
+    QIODevice* output,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    const QByteArray& authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
 
-    if (not IsRequestWasSuccessful(&request)) {
-        return {};
-    }
+    return RunCipherSession(
+        CryptoManager::OperationDecrypt,
+        key,
+        iv,
+        DecipherAuthentication(authCode, authTag),
+        input,
+        output,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
+}
+
+bool CipherDecipherRequests::cipherText(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& plainText,
+    QByteArray* cipherText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    QByteArray* authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
 
-    plaintext.append(request.generatedData());
+    return RunCipherSession(
+        CryptoManager::OperationEncrypt,
+        key,
+        iv,
+        CipherAuthentication(authCode, authTag),
+        plainText,
+        cipherText,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
+}
+
+bool CipherDecipherRequests::decipherText(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& cipherText,
+    QByteArray* plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    const QByteArray& authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    return RunCipherSession(
+        CryptoManager::OperationDecrypt,
+        key,
+        iv,
+        DecipherAuthentication(authCode, authTag),
+        cipherText,
+        plainText,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
+}
+
+bool CipherDecipherRequests::decipherText(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& cipherText,
+    SecureBuffer* plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+    const qint64 chunkSize,
+    const QByteArray& authCode,
+    const QByteArray& authTag)
+{
+    TraceScope trace(Q_FUNC_INFO);
 
-    return plaintext;
+    return RunCipherSession(
+        CryptoManager::OperationDecrypt,
+        key,
+        iv,
+        DecipherAuthentication(authCode, authTag),
+        cipherText,
+        plainText,
+        blockMode,
+        padding,
+        signaturePadding,
+        chunkSize);
 }
@@ -2,17 +2,36 @@
 
 #include <Sailfish/Crypto/key.h>
 
+class QIODevice;
+class ByteView;
+class SecureBuffer;
+
 class CipherDecipherRequests : public QObject {
     Q_OBJECT
 
 public:
+    /*
+      Amount of data which is sent to the cipher session with one UpdateCipher request.
+     */
+    static const qint64 DefaultChunkSize = 64 * 1024;
+
+    /*
+      With BlockModeGcm authCode is authenticated together with the data and authTag
+      is required. Cipher functions store the tag to authTag and fail if it is null,
+      decipher functions fail if authTag is empty or not verified. Streams write
+      deciphered data before the tag is verified, so the output must be discarded
+      when they fail.
+     */
     static QByteArray cipherText(
         const Sailfish::Crypto::Key& key,
         const QByteArray& iv,
         const QByteArray& plainText,
         const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
         const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
-        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding);
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr);
 
     static QByteArray decipherText(
         const Sailfish::Crypto::Key& key,
@@ -20,5 +39,78 @@ public:
         const QByteArray& ciphertext,
         const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
         const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
-        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding);
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        const QByteArray& authTag = QByteArray());
+
+    /*
+      Same as cipherText() and decipherText(), but the input is read in place and the
+      result is written to the caller's buffer, which keeps its memory between calls.
+      Return false on error.
+     */
+    static bool cipherText(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& plainText,
+        QByteArray* cipherText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr);
+
+    static bool decipherText(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& cipherText,
+        QByteArray* plainText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        const QByteArray& authTag = QByteArray());
+
+    /*
+      Same as decipherText(), but the plain text is collected in the locked memory
+      of the buffer and every chunk returned by the request is wiped once it is copied.
+      Copies kept by the daemon client library are not wiped.
+     */
+    static bool decipherText(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& cipherText,
+        SecureBuffer* plainText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        const QByteArray& authTag = QByteArray());
+
+    static bool cipherStream(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        QIODevice* input,
+        QIODevice* output,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr);
+
+    static bool decipherStream(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        QIODevice* input,
+        QIODevice* output,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const qint64 chunkSize = DefaultChunkSize,
+        const QByteArray& authCode = "",
+        const QByteArray& authTag = QByteArray());
 };
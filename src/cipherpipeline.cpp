@@ -0,0 +1,216 @@
+#include "cipherpipeline.h"
+#include "utils.h"
+#include "connections.h"
+#include "trace.h"
+
+#include <Sailfish/Crypto/cipherrequest.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QIODevice>
+
+using namespace Sailfish::Crypto;
+
+CipherPipeline::CipherPipeline(
+    const int windowSize,
+    const qint64 chunkSize,
+    QObject* parent)
+    : QObject(parent)
+    , m_windowSize(qMax(windowSize, 1))
+    , m_chunkSize(qMax<qint64>(chunkSize, 1))
+    , m_nextSession(0)
+    , m_activeSessions(0)
+{
+}
+
+CipherPipeline::~CipherPipeline()
+{
+    for (auto& session : m_sessions) {
+        delete session.request;
+    }
+}
+
+int CipherPipeline::addJob(const Job& job)
+{
+    Session session;
+    session.job = job;
+    session.state = SessionState::Pending;
+    session.request = nullptr;
+    m_sessions.append(session);
+    return m_sessions.size() - 1;
+}
+
+bool CipherPipeline::run()
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    if (m_sessions.isEmpty()) {
+        return true;
+    }
+
+    while (m_activeSessions < m_windowSize and m_nextSession < m_sessions.size()) {
+        startNextSession();
+    }
+
+    if (m_activeSessions > 0) {
+        m_loop.exec();
+    }
+
+    for (const auto& session : m_sessions) {
+        if (session.state != SessionState::Succeeded) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CipherPipeline::isSucceeded(const int jobIndex) const
+{
+    return m_sessions.at(jobIndex).state == SessionState::Succeeded;
+}
+
+void CipherPipeline::startNextSession()
+{
+    const int sessionIndex = m_nextSession++;
+    Session& session = m_sessions[sessionIndex];
+
+    if (not session.job.input or not session.job.input->isReadable() or
+        not session.job.output or not session.job.output->isWritable()) {
+        qDebug() << "Error when starting cipher session: bad arguments";
+        session.state = SessionState::Failed;
+        return;
+    }
+
+    CipherRequest* const request = new CipherRequest;
+    session.request = request;
+    session.state = SessionState::Initializing;
+    ++m_activeSessions;
+
+    /*
+      The next step of the session is started from a queued slot, so a request is
+      never restarted from inside of its own statusChanged emission.
+     */
+    connect(request, &CipherRequest::statusChanged, this, [this, sessionIndex] () {
+        if (m_sessions.at(sessionIndex).request->status() == Request::Finished) {
+            onRequestFinished(sessionIndex);
+        }
+    }, Qt::QueuedConnection);
+
+    request->setManager(Connections::cryptoManager());
+    request->setCipherMode(CipherRequest::InitializeCipher);
+    request->setKey(session.job.key);
+    request->setBlockMode(session.job.blockMode);
+    request->setEncryptionPadding(session.job.padding);
+    request->setSignaturePadding(session.job.signaturePadding);
+    request->setOperation(session.job.operation);
+    request->setInitializationVector(session.job.iv);
+    request->setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
+    request->startRequest();
+
+    // Prepare the first chunk while the session is being initialized.
+    if (not readNextChunk(session)) {
+        session.state = SessionState::Failed;
+    }
+}
+
+void CipherPipeline::onRequestFinished(const int sessionIndex)
+{
+    Session& session = m_sessions[sessionIndex];
+
+    if (session.state == SessionState::Failed or
+        not IsRequestWasSuccessful(session.request)) {
+        finishSession(session, SessionState::Failed);
+        return;
+    }
+
+    switch (session.state) {
+    case SessionState::Initializing:
+        sendNextChunk(session);
+        break;
+    case SessionState::Updating:
+        if (not writeGeneratedData(session)) {
+            finishSession(session, SessionState::Failed);
+            return;
+        }
+        sendNextChunk(session);
+        break;
+    case SessionState::Finalizing:
+        finishSession(session,
+                      writeGeneratedData(session) ?
+                      SessionState::Succeeded :
+                      SessionState::Failed);
+        break;
+    default:
+        break;
+    }
+}
+
+void CipherPipeline::sendNextChunk(Session& session)
+{
+    if (session.nextChunk.isEmpty()) {
+        session.state = SessionState::Finalizing;
+        session.request->setCipherMode(CipherRequest::FinalizeCipher);
+        session.request->setData(QByteArray());
+        session.request->startRequest();
+        return;
+    }
+
+    session.state = SessionState::Updating;
+    session.request->setCipherMode(CipherRequest::UpdateCipher);
+    session.request->setData(session.nextChunk);
+    session.request->startRequest();
+
+    // Read ahead while the daemon works on the current chunk.
+    if (not readNextChunk(session)) {
+        session.state = SessionState::Failed;
+    }
+}
+
+void CipherPipeline::finishSession(Session& session, const SessionState state)
+{
+    session.state = state;
+    session.nextChunk.clear();
+    session.request->disconnect(this);
+    session.request->setData(QByteArray());
+    --m_activeSessions;
+
+    while (m_activeSessions < m_windowSize and m_nextSession < m_sessions.size()) {
+        startNextSession();
+    }
+
+    if (m_activeSessions == 0) {
+        m_loop.quit();
+    }
+}
+
+bool CipherPipeline::readNextChunk(Session& session)
+{
+    session.nextChunk.clear();
+
+    if (session.job.input->atEnd()) {
+        return true;
+    }
+
+    session.nextChunk = session.job.input->read(m_chunkSize);
+    if (session.nextChunk.isEmpty()) {
+        qDebug() << "Error when reading cipher input:" << session.job.input->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool CipherPipeline::writeGeneratedData(Session& session)
+{
+    const QByteArray data = session.request->generatedData();
+    if (data.isEmpty()) {
+        return true;
+    }
+
+    if (session.job.output->write(data) != data.size()) {
+        qDebug() << "Error when writing cipher output:" << session.job.output->errorString();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "cipherdecipherrequests.h"
+
+#include <Sailfish/Crypto/key.h>
+#include <Sailfish/Crypto/cryptomanager.h>
+
+#include <QtCore/QEventLoop>
+#include <QtCore/QVector>
+
+class QIODevice;
+
+namespace Sailfish {
+    namespace Crypto {
+        class CipherRequest;
+    }
+}
+
+/*
+  Runs several cipher sessions at once on one event loop.
+  A cipher session in the daemon accepts only one request at a time, so at most one
+  UpdateCipher request per session is outstanding, but up to windowSize sessions are
+  kept in flight together. While a request is in flight the next chunk of its session
+  is read from the input, so the client does not sit idle during the IPC round-trip.
+  The output of every session is written in order to its own output device.
+ */
+class CipherPipeline : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultWindowSize = 4;
+
+    struct Job {
+        Sailfish::Crypto::CryptoManager::Operation operation;
+        Sailfish::Crypto::Key key;
+        QByteArray iv;
+        QIODevice* input;
+        QIODevice* output;
+        Sailfish::Crypto::CryptoManager::BlockMode blockMode;
+        Sailfish::Crypto::CryptoManager::EncryptionPadding padding;
+        Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding;
+    };
+
+    explicit CipherPipeline(
+        const int windowSize = DefaultWindowSize,
+        const qint64 chunkSize = CipherDecipherRequests::DefaultChunkSize,
+        QObject* parent = nullptr);
+    ~CipherPipeline();
+
+    int addJob(const Job& job);
+
+    /*
+      Runs all added jobs and blocks until every session is finished.
+      Returns true when all sessions were successful.
+     */
+    bool run();
+
+    bool isSucceeded(const int jobIndex) const;
+
+private:
+    enum class SessionState {
+        Pending,
+        Initializing,
+        Updating,
+        Finalizing,
+        Succeeded,
+        Failed
+    };
+
+    struct Session {
+        Job job;
+        SessionState state;
+        Sailfish::Crypto::CipherRequest* request;
+        QByteArray nextChunk;
+    };
+
+    void startNextSession();
+    void onRequestFinished(const int sessionIndex);
+    void sendNextChunk(Session& session);
+    void finishSession(Session& session, const SessionState state);
+    bool readNextChunk(Session& session);
+    bool writeGeneratedData(Session& session);
+
+    const int m_windowSize;
+    const qint64 m_chunkSize;
+    QVector<Session> m_sessions;
+    int m_nextSession;
+    int m_activeSessions;
+    QEventLoop m_loop;
+};
@@ -0,0 +1,125 @@
+#include "connections.h"
+
+#include <Sailfish/Crypto/cryptomanager.h>
+#include <Sailfish/Secrets/secretmanager.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThreadStorage>
+
+#include <deque>
+#include <memory>
+
+using namespace Sailfish::Crypto;
+using namespace Sailfish::Secrets;
+
+namespace {
+
+    const qint64 MIN_RECONNECT_INTERVAL = 1000; // milliseconds
+    const qint64 MAX_RECONNECT_INTERVAL = 60 * 1000; // milliseconds
+
+    // Longer than any request started with a manager is expected to run.
+    const qint64 RETIRED_MANAGER_LIFETIME = 5 * 60 * 1000; // milliseconds
+    const std::size_t MAX_RETIRED_MANAGERS = 16;
+
+    /*
+      Requests keep a pointer to the manager they were started with, so a manager
+      which lost its connection is not destroyed at once but retired. Retired managers
+      are deleted when their requests are expected to be finished, and the oldest ones
+      also when there are too many of them, so a flapping daemon does not grow the list.
+     */
+    template <typename Manager>
+    struct ManagerSlot {
+        struct Retired {
+            std::unique_ptr<Manager> manager;
+            QElapsedTimer sinceRetired;
+        };
+
+        std::unique_ptr<Manager> current;
+        std::deque<Retired> retired;
+        QElapsedTimer sinceReconnect;
+        qint64 reconnectInterval = MIN_RECONNECT_INTERVAL;
+
+        void retire()
+        {
+            if (current) {
+                Retired entry;
+                entry.manager = std::move(current);
+                entry.sinceRetired.start();
+                retired.push_back(std::move(entry));
+            }
+
+            purge();
+        }
+
+        void purge()
+        {
+            while (not retired.empty() and
+                   (retired.size() > MAX_RETIRED_MANAGERS or
+                    retired.front().sinceRetired.elapsed() > RETIRED_MANAGER_LIFETIME)) {
+                // Events queued for the manager are delivered before it is deleted.
+                retired.front().manager.release()->deleteLater();
+                retired.pop_front();
+            }
+        }
+
+        Manager* get(const char* name)
+        {
+            purge();
+
+            if (current and current->isInitialized()) {
+                reconnectInterval = MIN_RECONNECT_INTERVAL;
+                return current.get();
+            }
+
+            if (current) {
+                if (sinceReconnect.isValid() and sinceReconnect.elapsed() < reconnectInterval) {
+                    return current.get();
+                }
+
+                qDebug() << name << "daemon connection lost, reconnecting";
+                retire();
+                reconnectInterval = qMin(2 * reconnectInterval, MAX_RECONNECT_INTERVAL);
+            }
+
+            current.reset(new Manager);
+            sinceReconnect.start();
+            return current.get();
+        }
+    };
+
+    struct ThreadConnections {
+        ManagerSlot<CryptoManager> cryptoManager;
+        ManagerSlot<SecretManager> secretManager;
+    };
+
+    QThreadStorage<ThreadConnections*> connections;
+
+    ThreadConnections* GetThreadConnections()
+    {
+        if (not connections.hasLocalData()) {
+            connections.setLocalData(new ThreadConnections);
+        }
+        return connections.localData();
+    }
+
+} // anonymous namespace
+
+CryptoManager* Connections::cryptoManager()
+{
+    return GetThreadConnections()->cryptoManager.get("Crypto");
+}
+
+SecretManager* Connections::secretManager()
+{
+    return GetThreadConnections()->secretManager.get("Secrets");
+}
+
+void Connections::reset()
+{
+    if (connections.hasLocalData()) {
+        ThreadConnections* const local = connections.localData();
+        local->cryptoManager.retire();
+        local->secretManager.retire();
+    }
+}
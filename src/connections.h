@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QtCore/QObject>
+
+namespace Sailfish {
+    namespace Crypto {
+        class CryptoManager;
+    }
+    namespace Secrets {
+        class SecretManager;
+    }
+}
+
+/*
+  Connections to the secrets daemon which are shared by all request wrappers.
+  Every thread gets its own CryptoManager and SecretManager, they are created on the
+  first use and live until the thread is finished. If the daemon was restarted and
+  the manager lost its connection, a new manager is created on the next call, at most
+  once per reconnect interval. Replaced managers are kept alive for a few minutes,
+  so requests which still refer to them are safe.
+ */
+class Connections : public QObject {
+    Q_OBJECT
+
+public:
+    static Sailfish::Crypto::CryptoManager* cryptoManager();
+    static Sailfish::Secrets::SecretManager* secretManager();
+
+    /*
+      Replaces connections of the calling thread on the next use, the old ones are
+      retired like the lost ones.
+     */
+    static void reset();
+};
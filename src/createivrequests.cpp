@@ -1,34 +1,94 @@
 #include "createivrequests.h"
 #include "utils.h"
+#include "connections.h"
+#include "asyncrequest.h"
+#include "localplugins.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/generateinitializationvectorrequest.h>
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
 
 #include <QtCore/QDebug>
 
 using namespace Sailfish::Crypto;
 
+namespace {
+
+    void SetupIVRequest(
+        GenerateInitializationVectorRequest& request,
+        const CryptoManager::Algorithm algorithm,
+        const CryptoManager::BlockMode blockMode,
+        const std::size_t keyLength,
+        const QString& pluginName)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setAlgorithm(algorithm);
+        request.setKeySize(keyLength);
+        request.setBlockMode(blockMode);
+        request.setCryptoPluginName(pluginName);
+    }
+
+} // anonymous namespace
+
 QByteArray CreateIVRequests::createIV(
     const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
     const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
     const std::size_t keyLength,
     const QString& pluginName)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
+
+    MetricsScope metrics("create_iv", Metrics::algorithmName(algorithm), pluginName);
+
+    if (CryptoPlugin* const plugin = LocalPlugins::plugin(pluginName)) {
+        QByteArray iv;
+        const Result result = plugin->generateInitializationVector(
+            algorithm, blockMode, keyLength, QVariantMap(), &iv);
+
+        if (not IsResultWasSuccessful(result)) {
+            qDebug() << "Error when generating IV";
+            throw std::runtime_error("Error when generating IV");
+        }
+
+        metrics.setSucceeded(iv.size());
+        return iv;
+    }
 
-    CryptoManager manager;
+    trace.phase("setup");
     GenerateInitializationVectorRequest request;
-    request.setManager(&manager);
-    request.setAlgorithm(algorithm);
-    request.setKeySize(keyLength);
-    request.setBlockMode(blockMode);
-    request.setCryptoPluginName(pluginName);
+    SetupIVRequest(request, algorithm, blockMode, keyLength, pluginName);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         qDebug() << "Error when generating IV";
         throw std::runtime_error("Error when generating IV");
     }
 
-    return request.generatedInitializationVector();
+    const QByteArray iv = request.generatedInitializationVector();
+    metrics.setSucceeded(iv.size());
+    return iv;
+}
+
+QFuture<QByteArray> CreateIVRequests::createIVAsync(
+    const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    GenerateInitializationVectorRequest* const request = new GenerateInitializationVectorRequest;
+    SetupIVRequest(*request, algorithm, blockMode, keyLength, pluginName);
+
+    return StartAsyncRequest<QByteArray>(
+        request,
+        [] (const GenerateInitializationVectorRequest& finished) {
+            return finished.generatedInitializationVector();
+        },
+        "Error when generating IV");
 }
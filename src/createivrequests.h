@@ -3,6 +3,8 @@
 #include <Sailfish/Crypto/key.h>
 #include <Sailfish/Crypto/cryptomanager.h>
 
+#include <QtCore/QFuture>
+
 class CreateIVRequests : public QObject {
     Q_OBJECT
 
@@ -12,4 +14,10 @@ public:
         const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
         const std::size_t keyLength,
         const QString& pluginName);
+
+    static QFuture<QByteArray> createIVAsync(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const std::size_t keyLength,
+        const QString& pluginName);
 };
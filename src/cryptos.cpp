@@ -3,17 +3,30 @@
 #include "encryptdecryptrequests.h"
 #include "generatekeyrequests.h"
 #include "createivrequests.h"
+#include "ivpool.h"
 #include "cipherdecipherrequests.h"
 #include "digestrequests.h"
+#include "keycache.h"
+#include "mappedfile.h"
+#include "kdfcalibration.h"
+#include "randompool.h"
+#include "sealedmessages.h"
+#include "envelopeencryption.h"
+#include "securearena.h"
 
 #include <Sailfish/Crypto/cryptomanager.h>
 #include <Sailfish/Crypto/generaterandomdatarequest.h>
 
+#include <QtCore/QBuffer>
+#include <QtCore/QCommandLineParser>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
 #include <QtCore/QStringList>
 #include <QtCore/QLoggingCategory>
 #include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <stdexcept>
 
 using namespace Sailfish::Crypto;
 
@@ -192,7 +205,8 @@ namespace {
       надежные и случайные данные для своей работы, чтобы надежность ключа была
       максимальной.
      */
-    void EncryptAndDecryptWithAuth(const Sailfish::Crypto::Key& key,
+    void EncryptAndDecryptWithAuth(IVPool& ivPool,
+                                   const Sailfish::Crypto::Key& key,
                                    const QByteArray& plainText,
                                    const QByteArray& authCode)
     {
@@ -202,7 +216,7 @@ namespace {
         constexpr auto padding = CryptoManager::EncryptionPaddingNone;
 
         const auto iv =
-            CreateIVRequests::createIV(
+            ivPool.takeIV(
                 key.algorithm(),
                 blockMode,
                 key.size(),
@@ -240,7 +254,8 @@ namespace {
       Здесь используются те же параметры, что и в функции выше, которая работает с кодом
       авторизации, только без него.
      */
-    void EncryptAndDecryptWithoutAuth(const Sailfish::Crypto::Key& key,
+    void EncryptAndDecryptWithoutAuth(IVPool& ivPool,
+                                      const Sailfish::Crypto::Key& key,
                                       const QByteArray& plainText)
     {
         qDebug() << Q_FUNC_INFO;
@@ -249,7 +264,7 @@ namespace {
         constexpr auto padding = CryptoManager::EncryptionPaddingNone;
 
         const QByteArray iv =
-            CreateIVRequests::createIV(
+            ivPool.takeIV(
                 key.algorithm(),
                 blockMode,
                 key.size(),
@@ -293,7 +308,8 @@ namespace {
       аутентификации, все параметры те же, что и в предыдущих функциях, за исключением
       имени плагина, алгоритма шифрования, наименования функции хэширования.
      */
-    void EncryptAndDecryptWithoutAuthGost(const Sailfish::Crypto::Key&,
+    void EncryptAndDecryptWithoutAuthGost(IVPool& ivPool,
+                                          const Sailfish::Crypto::Key&,
                                           const QByteArray& plainText)
     {
         qDebug() << Q_FUNC_INFO;
@@ -324,7 +340,7 @@ namespace {
             pluginName);
 
         const QByteArray iv =
-            CreateIVRequests::createIV(
+            ivPool.takeIV(
                 key.algorithm(),
                 blockMode,
                 key.size(),
@@ -360,7 +376,7 @@ namespace {
       Функция, которыя вызывается различные функции для шифрования и расшифрования
       с применением различных алгоритмов (AES & Gost).
      */
-    void EncryptAndDecrypt()
+    void EncryptAndDecrypt(IVPool& ivPool)
     {
         qDebug() << Q_FUNC_INFO;
 
@@ -376,9 +392,9 @@ namespace {
             256 /*key length: 128, 192, 256 for AES*/,
             CryptoManager::DefaultCryptoPluginName);
 
-        EncryptAndDecryptWithAuth(aesKey, plainText, QByteArray("my_password"));
-        EncryptAndDecryptWithoutAuth(aesKey, plainText);
-        EncryptAndDecryptWithoutAuthGost(aesKey, plainText);
+        EncryptAndDecryptWithAuth(ivPool, aesKey, plainText, QByteArray("my_password"));
+        EncryptAndDecryptWithoutAuth(ivPool, aesKey, plainText);
+        EncryptAndDecryptWithoutAuthGost(ivPool, aesKey, plainText);
     }
 
     /*
@@ -391,7 +407,7 @@ namespace {
       необходимо завершить шифрование используя запрос FinalizeCipher.
       Алгоритм расшифрования имеет тот же алгоритм.
      */
-    void CipherAndDecipher()
+    void CipherAndDecipher(IVPool& ivPool)
     {
         qDebug() << Q_FUNC_INFO;
 
@@ -408,7 +424,7 @@ namespace {
             CryptoManager::DefaultCryptoPluginName);
 
         const auto iv =
-            CreateIVRequests::createIV(
+            ivPool.takeIV(
                 aesKey.algorithm(),
                 CryptoManager::BlockModeCbc,
                 aesKey.size(),
@@ -487,6 +503,512 @@ namespace {
         Q_ASSERT(digest.size() == 32);
     }
 
+    /*
+      Возвращает true, если функция бросила исключение std::runtime_error.
+     */
+    template <typename Function>
+    bool IsThrown(Function function)
+    {
+        try {
+            function();
+        } catch (const std::runtime_error& error) {
+            qDebug() << "Expected error:" << error.what();
+            return true;
+        }
+        return false;
+    }
+
+    /*
+      Запечатанное сообщение шифруется по частям (chunk) в режиме GCM и подписывается
+      одной подписью. Каждая часть аутентифицирует свой номер и заголовок конверта,
+      поэтому измененная, переставленная или отброшенная часть, а также неверная
+      подпись, приводят к исключению при открытии.
+      Функции sealStream и openStream работают с устройствами и держат в памяти
+      только windowSize частей.
+     */
+    void SealAndOpenMessage()
+    {
+        qDebug() << Q_FUNC_INFO;
+
+        const QByteArray plainText = "The quick brown fox jumps over the lazy dog";
+        const auto pluginName = CryptoManager::DefaultCryptoPluginName;
+        constexpr auto padding = CryptoManager::SignaturePaddingNone;
+        constexpr auto digestFunction = CryptoManager::DigestSha256;
+        // Маленький размер части, чтобы сообщение состояло из нескольких частей.
+        constexpr auto chunkSize = 16;
+
+        const auto aesKey = GenerateKeyRequests::createStoredKey(
+            "MyAesKeyForSeal",
+            "ExampleCollection",
+            "org.sailfishos.secrets.plugin.storage.sqlite",
+            CryptoManager::AlgorithmAes,
+            CryptoManager::OperationEncrypt | CryptoManager::OperationDecrypt,
+            CryptoManager::DigestSha256,
+            256,
+            pluginName);
+
+        const auto rsaKey = GenerateKeyRequests::createStoredKey(
+            "MyRsaKeyForSeal",
+            "ExampleCollection",
+            "org.sailfishos.secrets.plugin.storage.sqlite",
+            CryptoManager::AlgorithmRsa,
+            CryptoManager::OperationSign | CryptoManager::OperationVerify,
+            digestFunction,
+            2048,
+            pluginName);
+
+        const auto openEnvelope = [&] (const QByteArray& envelope) {
+            return SealedMessages::open(
+                aesKey, rsaKey, envelope, pluginName, pluginName, padding, digestFunction);
+        };
+
+        const QByteArray envelope =
+            SealedMessages::seal(
+                aesKey,
+                rsaKey,
+                plainText,
+                pluginName,
+                pluginName,
+                padding,
+                digestFunction,
+                chunkSize);
+
+        Q_ASSERT(openEnvelope(envelope) == plainText);
+
+        // Заголовок: "CSE1", версия, размер части, число частей, длина IV и IV.
+        const int headerSize = 14 + static_cast<uchar>(envelope.at(13));
+        // Размер данных, данные, размер тега и тег полной части.
+        const int chunkRecordSize = 4 + chunkSize + 1 + 16;
+
+        QByteArray modified = envelope;
+        modified[headerSize + 4] = modified.at(headerSize + 4) ^ 1;
+        Q_ASSERT(IsThrown([&] () { openEnvelope(modified); }));
+
+        QByteArray reordered = envelope;
+        reordered.replace(headerSize, chunkRecordSize, envelope.mid(headerSize + chunkRecordSize, chunkRecordSize));
+        reordered.replace(headerSize + chunkRecordSize, chunkRecordSize, envelope.mid(headerSize, chunkRecordSize));
+        Q_ASSERT(IsThrown([&] () { openEnvelope(reordered); }));
+
+        const QByteArray truncated = envelope.left(headerSize + chunkRecordSize);
+        Q_ASSERT(IsThrown([&] () { openEnvelope(truncated); }));
+
+        QByteArray badSignature = envelope;
+        badSignature[badSignature.size() - 1] = badSignature.at(badSignature.size() - 1) ^ 1;
+        Q_ASSERT(IsThrown([&] () { openEnvelope(badSignature); }));
+
+        QByteArray plainTextData = plainText;
+        QBuffer input(&plainTextData);
+        input.open(QIODevice::ReadOnly);
+        QBuffer sealed;
+        sealed.open(QIODevice::WriteOnly);
+        SealedMessages::sealStream(
+            aesKey, rsaKey, &input, &sealed, pluginName, pluginName, padding, digestFunction, chunkSize);
+
+        QByteArray sealedData = sealed.data();
+        Q_ASSERT(openEnvelope(sealedData) == plainText);
+
+        QBuffer sealedInput(&sealedData);
+        sealedInput.open(QIODevice::ReadOnly);
+        QBuffer opened;
+        opened.open(QIODevice::WriteOnly);
+        SealedMessages::openStream(
+            aesKey, rsaKey, &sealedInput, &opened, pluginName, pluginName, padding, digestFunction);
+
+        Q_ASSERT(opened.data() == plainText);
+
+        QBuffer badSignatureInput(&badSignature);
+        badSignatureInput.open(QIODevice::ReadOnly);
+        QBuffer notOpened;
+        notOpened.open(QIODevice::WriteOnly);
+        Q_ASSERT(IsThrown([&] () {
+            SealedMessages::openStream(
+                aesKey, rsaKey, &badSignatureInput, &notOpened, pluginName, pluginName, padding, digestFunction);
+        }));
+        // Подпись проверяется до расшифрования, поэтому ничего не записано.
+        Q_ASSERT(notOpened.data().isEmpty());
+    }
+
+    /*
+      Конвертное шифрование: каждый объект шифруется своим случайным ключом данных,
+      а хранимым ключом шифруется только ключ данных. Расшифрованные ключи данных
+      недолго хранятся в кэше, поэтому повторное открытие не обращается к демону.
+      Измененные данные, ключ данных или тег, а также обрезанный конверт, приводят к
+      исключению при открытии.
+     */
+    void SealAndOpenEnvelope()
+    {
+        qDebug() << Q_FUNC_INFO;
+
+        const QByteArray plainText = "The quick brown fox jumps over the lazy dog";
+        const auto pluginName = CryptoManager::DefaultCryptoPluginName;
+
+        const auto aesKey = GenerateKeyRequests::createStoredKey(
+            "MyAesKeyForEnvelope",
+            "ExampleCollection",
+            "org.sailfishos.secrets.plugin.storage.sqlite",
+            CryptoManager::AlgorithmAes,
+            CryptoManager::OperationEncrypt | CryptoManager::OperationDecrypt,
+            CryptoManager::DigestSha256,
+            256,
+            pluginName);
+
+        const auto openEnvelope = [&] (const QByteArray& envelope) {
+            return EnvelopeEncryption::open(aesKey, envelope, pluginName, pluginName);
+        };
+
+        const QByteArray envelope =
+            EnvelopeEncryption::seal(
+                aesKey,
+                plainText,
+                pluginName,
+                pluginName);
+
+        // Ключ данных берется из кэша.
+        Q_ASSERT(openEnvelope(envelope) == plainText);
+
+        // Ключ данных расшифровывается хранимым ключом.
+        EnvelopeEncryption::clearCache();
+        SecureBuffer securePlainText;
+        EnvelopeEncryption::open(aesKey, envelope, &securePlainText, pluginName, pluginName);
+        Q_ASSERT(QByteArray(securePlainText.constData(), securePlainText.size()) == plainText);
+
+        // "CEE1", версия, IV и тег ключа данных, ключ данных, IV.
+        const int wrappedKeyOffset = 4 + 1 + 12 + 16;
+        const int headerSize = wrappedKeyOffset + EnvelopeEncryption::DataKeySize + 12;
+
+        QByteArray modifiedData = envelope;
+        modifiedData[headerSize] = modifiedData.at(headerSize) ^ 1;
+        Q_ASSERT(IsThrown([&] () { openEnvelope(modifiedData); }));
+
+        QByteArray modifiedKey = envelope;
+        modifiedKey[wrappedKeyOffset] = modifiedKey.at(wrappedKeyOffset) ^ 1;
+        Q_ASSERT(IsThrown([&] () { openEnvelope(modifiedKey); }));
+
+        QByteArray modifiedTag = envelope;
+        modifiedTag[modifiedTag.size() - 1] = modifiedTag.at(modifiedTag.size() - 1) ^ 1;
+        Q_ASSERT(IsThrown([&] () { openEnvelope(modifiedTag); }));
+
+        const QByteArray truncated = envelope.left(envelope.size() - 1);
+        Q_ASSERT(IsThrown([&] () { openEnvelope(truncated); }));
+
+        const QByteArray truncatedHeader = envelope.left(headerSize);
+        Q_ASSERT(IsThrown([&] () { openEnvelope(truncatedHeader); }));
+    }
+
+    /*
+      Шифрование и расшифрование файлов с помощью хранимого ключа.
+      Входной файл отображается в память (mmap) окнами и передается в сессию шифрования
+      порциями по chunk-size байт, результат пишется в выходной файл по мере получения.
+      Таким образом файл целиком никогда не находится в памяти процесса.
+      Формат зашифрованного файла: 1 байт версии формата, 1 байт блочного режима,
+      1 байт длины вектора инициализации, сам вектор инициализации, для GCM 16 байт
+      тега аутентификации и далее зашифрованные данные. Заголовок до тега
+      аутентифицируется в режиме GCM вместе с данными.
+      Режим хранится в файле, поэтому при расшифровании его можно не указывать, а
+      указанный режим, отличный от сохраненного, приводит к понятной ошибке.
+      Пример:
+        cryptos encrypt --key MyAesKey backup.tar backup.tar.enc
+        cryptos decrypt --key MyAesKey backup.tar.enc backup.tar
+     */
+    const int GcmTagSize = 16;
+    const char FileFormatVersion = 1;
+
+    // Коды режимов в файле не зависят от значений перечисления CryptoManager.
+    char FileBlockModeCode(const CryptoManager::BlockMode blockMode)
+    {
+        switch (blockMode) {
+        case CryptoManager::BlockModeCbc:
+            return 1;
+        case CryptoManager::BlockModeOfb:
+            return 2;
+        case CryptoManager::BlockModeCtr:
+            return 3;
+        case CryptoManager::BlockModeGcm:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    CryptoManager::BlockMode FileBlockMode(const char code)
+    {
+        switch (code) {
+        case 1:
+            return CryptoManager::BlockModeCbc;
+        case 2:
+            return CryptoManager::BlockModeOfb;
+        case 3:
+            return CryptoManager::BlockModeCtr;
+        case 4:
+            return CryptoManager::BlockModeGcm;
+        default:
+            return CryptoManager::BlockModeUnknown;
+        }
+    }
+
+    CryptoManager::BlockMode ParseBlockMode(const QString& name)
+    {
+        if (name == "cbc") {
+            return CryptoManager::BlockModeCbc;
+        }
+        if (name == "ofb") {
+            return CryptoManager::BlockModeOfb;
+        }
+        if (name == "ctr") {
+            return CryptoManager::BlockModeCtr;
+        }
+        if (name == "gcm") {
+            return CryptoManager::BlockModeGcm;
+        }
+        return CryptoManager::BlockModeUnknown;
+    }
+
+    bool EncryptFile(const Sailfish::Crypto::Key& key,
+                     const CryptoManager::BlockMode blockMode,
+                     const qint64 chunkSize,
+                     const QString& inputName,
+                     const QString& outputName)
+    {
+        const Sailfish::Crypto::Key metadata =
+            KeyCache::storedKey(key.identifier(), Sailfish::Crypto::Key::MetaData);
+
+        const QByteArray iv =
+            CreateIVRequests::createIV(
+                metadata.algorithm(),
+                blockMode,
+                metadata.size(),
+                CryptoManager::DefaultCryptoPluginName);
+
+        MappedFile input(inputName);
+        if (not input.open(QIODevice::ReadOnly)) {
+            qDebug() << "Can't open" << inputName << input.errorString();
+            return false;
+        }
+
+        QSaveFile output(outputName);
+        if (not output.open(QIODevice::WriteOnly)) {
+            qDebug() << "Can't open" << outputName << output.errorString();
+            return false;
+        }
+
+        QByteArray header;
+        header.append(FileFormatVersion);
+        header.append(FileBlockModeCode(blockMode));
+        header.append(static_cast<char>(iv.size()));
+        header.append(iv);
+        if (output.write(header) != header.size()) {
+            qDebug() << "Can't write" << outputName << output.errorString();
+            output.cancelWriting();
+            return false;
+        }
+
+        // Для GCM место под тег резервируется в заголовке, а сам заголовок
+        // аутентифицируется вместе с данными.
+        const bool authenticated = blockMode == CryptoManager::BlockModeGcm;
+        const qint64 tagPosition = output.pos();
+        if (authenticated and output.write(QByteArray(GcmTagSize, '\0')) != GcmTagSize) {
+            qDebug() << "Can't write" << outputName << output.errorString();
+            output.cancelWriting();
+            return false;
+        }
+
+        QByteArray tag;
+        if (not CipherDecipherRequests::cipherStream(
+                key,
+                iv,
+                &input,
+                &output,
+                blockMode,
+                CryptoManager::EncryptionPaddingNone,
+                CryptoManager::SignaturePaddingNone,
+                chunkSize,
+                authenticated ? header : QByteArray(),
+                authenticated ? &tag : nullptr)) {
+            output.cancelWriting();
+            return false;
+        }
+
+        if (authenticated) {
+            if (tag.size() != GcmTagSize or not output.seek(tagPosition) or
+                output.write(tag) != tag.size()) {
+                qDebug() << "Error when writing authentication tag" << outputName;
+                output.cancelWriting();
+                return false;
+            }
+        }
+
+        return output.commit();
+    }
+
+    /*
+      requestedBlockMode равен BlockModeUnknown, если режим не был указан явно.
+     */
+    bool DecryptFile(const Sailfish::Crypto::Key& key,
+                     const CryptoManager::BlockMode requestedBlockMode,
+                     const qint64 chunkSize,
+                     const QString& inputName,
+                     const QString& outputName)
+    {
+        MappedFile input(inputName);
+        if (not input.open(QIODevice::ReadOnly)) {
+            qDebug() << "Can't open" << inputName << input.errorString();
+            return false;
+        }
+
+        const QByteArray prefix = input.read(3);
+        if (prefix.size() != 3 or prefix[0] != FileFormatVersion) {
+            qDebug() << "Bad encrypted file header or unsupported version" << inputName;
+            return false;
+        }
+
+        const CryptoManager::BlockMode blockMode = FileBlockMode(prefix[1]);
+        if (blockMode == CryptoManager::BlockModeUnknown) {
+            qDebug() << "Unknown block mode in encrypted file" << inputName;
+            return false;
+        }
+        if (requestedBlockMode != CryptoManager::BlockModeUnknown and
+            requestedBlockMode != blockMode) {
+            qDebug() << "File" << inputName << "was encrypted with another block mode";
+            return false;
+        }
+
+        const int ivLength = static_cast<uchar>(prefix[2]);
+        const QByteArray iv = input.read(ivLength);
+        if (iv.size() != ivLength) {
+            qDebug() << "Bad encrypted file header" << inputName;
+            return false;
+        }
+
+        const bool authenticated = blockMode == CryptoManager::BlockModeGcm;
+        const QByteArray header = prefix + iv;
+        const QByteArray tag = authenticated ? input.read(GcmTagSize) : QByteArray();
+        if (authenticated and tag.size() != GcmTagSize) {
+            qDebug() << "Bad encrypted file header" << inputName;
+            return false;
+        }
+
+        QSaveFile output(outputName);
+        if (not output.open(QIODevice::WriteOnly)) {
+            qDebug() << "Can't open" << outputName << output.errorString();
+            return false;
+        }
+
+        if (not CipherDecipherRequests::decipherStream(
+                key,
+                iv,
+                &input,
+                &output,
+                blockMode,
+                CryptoManager::EncryptionPaddingNone,
+                CryptoManager::SignaturePaddingNone,
+                chunkSize,
+                authenticated ? header : QByteArray(),
+                tag)) {
+            // Расшифрованные данные не сохраняются, если тег не прошел проверку.
+            output.cancelWriting();
+            return false;
+        }
+
+        return output.commit();
+    }
+
+    int RunFileCommand(const QCoreApplication& app)
+    {
+        QCommandLineParser parser;
+        parser.addHelpOption();
+        parser.addPositionalArgument("command", "encrypt or decrypt");
+        parser.addPositionalArgument("input", "Input file.");
+        parser.addPositionalArgument("output", "Output file.");
+        parser.addOption({"key", "Name of the stored key.", "name"});
+        parser.addOption({"collection", "Collection of the stored key.", "name",
+                          "ExampleCollection"});
+        parser.addOption({"storage", "Storage plugin of the stored key.", "name",
+                          "org.sailfishos.secrets.plugin.storage.sqlite"});
+        parser.addOption({"mode", "Block mode: ctr, ofb, gcm or cbc (whole blocks only). "
+                          "Decryption takes it from the file.", "mode", "ctr"});
+        parser.addOption({"chunk-size", "Size of every cipher session update in bytes.", "bytes",
+                          QString::number(1024 * 1024)});
+        parser.process(app);
+
+        const QStringList arguments = parser.positionalArguments();
+        const CryptoManager::BlockMode blockMode = ParseBlockMode(parser.value("mode"));
+        const qint64 chunkSize = parser.value("chunk-size").toLongLong();
+
+        if (arguments.size() != 3 or not parser.isSet("key") or
+            blockMode == CryptoManager::BlockModeUnknown or chunkSize <= 0) {
+            parser.showHelp(1);
+        }
+
+        const Sailfish::Crypto::Key key(
+            parser.value("key"),
+            parser.value("collection"),
+            parser.value("storage"));
+
+        try {
+            const bool succeeded = arguments.at(0) == "encrypt" ?
+                EncryptFile(key, blockMode, chunkSize, arguments.at(1), arguments.at(2)) :
+                DecryptFile(key,
+                            parser.isSet("mode") ? blockMode : CryptoManager::BlockModeUnknown,
+                            chunkSize, arguments.at(1), arguments.at(2));
+            return succeeded ? 0 : 1;
+        } catch (const std::exception& e) {
+            qDebug() << e.what();
+            return 1;
+        }
+    }
+
+    /*
+      Измеряет стоимость PBKDF2 на текущем устройстве и сохраняет количество итераций,
+      при котором вывод ключа занимает заданное время. Это количество итераций затем
+      используется при создании всех ключей.
+     */
+    int RunCalibrateCommand(const QCoreApplication& app)
+    {
+        QCommandLineParser parser;
+        parser.addHelpOption();
+        parser.addPositionalArgument("command", "calibrate-kdf");
+        parser.addOption({"target", "Target key derivation time in milliseconds.", "ms",
+                          QString::number(KdfCalibration::DefaultTargetLatency)});
+        parser.process(app);
+
+        const qint64 targetLatency = parser.value("target").toLongLong();
+        if (targetLatency <= 0) {
+            parser.showHelp(1);
+        }
+
+        const CryptoManager::DigestFunction digestFunctions[] = {
+            CryptoManager::DigestSha256,
+            CryptoManager::DigestSha512,
+            CryptoManager::DigestGost_2012_256
+        };
+
+        try {
+            for (const auto digestFunction : digestFunctions) {
+                const QString pluginName = digestFunction == CryptoManager::DigestGost_2012_256 ?
+                    QStringLiteral("org.sailfishos.plugin.encryption.gost") :
+                    CryptoManager::DefaultCryptoPluginName;
+                const KdfCalibration::Profile profile =
+                    KdfCalibration::calibrate(digestFunction, targetLatency, pluginName);
+                qDebug() << digestFunction << profile.iterations << "iterations";
+            }
+        } catch (const std::exception& e) {
+            qDebug() << e.what();
+            return 1;
+        }
+
+        return 0;
+    }
+
+    /*
+      Удаляет пул случайных данных текущего потока при выходе из области видимости.
+     */
+    struct ThreadPoolRelease {
+        ~ThreadPoolRelease()
+        {
+            RandomPool::releaseThreadPool();
+        }
+    };
+
 } // anonymous namespace
 
 /*
@@ -499,6 +1021,32 @@ int main(int argc, char **argv)
 {
     QCoreApplication app(argc, argv);
 
+    /*
+      Пул случайных данных главного потока должен быть удален раньше объекта
+      приложения.
+     */
+    const ThreadPoolRelease threadPoolRelease;
+
+    /*
+      Команды encrypt и decrypt шифруют и расшифровывают файлы, без команды
+      выполняются примеры, приведенные ниже.
+     */
+    const QStringList arguments = app.arguments();
+    if (arguments.size() > 1 and
+        (arguments.at(1) == "encrypt" or arguments.at(1) == "decrypt")) {
+        return RunFileCommand(app);
+    }
+
+    if (arguments.size() > 1 and arguments.at(1) == "calibrate-kdf") {
+        return RunCalibrateCommand(app);
+    }
+
+    /*
+      Загружает список плагинов, коллекций и ключей одновременно, последующие
+      запросы метаданных берут их из кэша.
+     */
+    Requests::warmUp();
+
     /*
       Печатает список плагинов ,которые установлены в системе.
      */
@@ -525,15 +1073,27 @@ int main(int argc, char **argv)
         }
     }
 
+    /*
+      Векторы инициализации заранее запрашиваются пачками в фоне, шифрование
+      берет готовые из пула.
+     */
+    IVPool ivPool;
+    ivPool.prefill(CryptoManager::AlgorithmAes, CryptoManager::BlockModeGcm, 256,
+                   CryptoManager::DefaultCryptoPluginName);
+    ivPool.prefill(CryptoManager::AlgorithmAes, CryptoManager::BlockModeCbc, 256,
+                   CryptoManager::DefaultCryptoPluginName);
+
     if (Requests::createCollection()) {
         qDebug() << "Create collection was successful\n";
 
         CheckSignAndVerify();
         CheckSignAndVerifyGost();
-        EncryptAndDecrypt();
-        CipherAndDecipher();
+        EncryptAndDecrypt(ivPool);
+        CipherAndDecipher(ivPool);
         DeleteStoredKey();
         DigestGost();
+        SealAndOpenMessage();
+        SealAndOpenEnvelope();
     }
 
     return app.exec();
@@ -1,33 +1,435 @@
 #include "digestrequests.h"
+#include "byteview.h"
 #include "utils.h"
+#include "connections.h"
+#include "asyncrequest.h"
+#include "mappedfile.h"
+#include "localplugins.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/calculatedigestrequest.h>
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
 
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include <nettle/streebog.h>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
 
 using namespace Sailfish::Crypto;
 
+namespace {
+
+    void SetupDigestRequest(
+        CalculateDigestRequest& request,
+        const QByteArray& data,
+        const CryptoManager::SignaturePadding padding,
+        const CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setPadding(padding);
+        request.setDigestFunction(digestFunction);
+        request.setCryptoPluginName(pluginName);
+        request.setData(data);
+    }
+
+    bool GetLocalAlgorithm(const CryptoManager::DigestFunction digestFunction,
+                           QCryptographicHash::Algorithm* algorithm)
+    {
+        switch (digestFunction) {
+        case CryptoManager::DigestSha1:
+            *algorithm = QCryptographicHash::Sha1;
+            return true;
+        case CryptoManager::DigestSha256:
+            *algorithm = QCryptographicHash::Sha256;
+            return true;
+        case CryptoManager::DigestSha512:
+            *algorithm = QCryptographicHash::Sha512;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /*
+      Incremental digest calculated in the process. SHA digests are calculated by
+      QCryptographicHash, GOST R 34.11-2012 (Streebog) by nettle. Both give the same
+      bytes as the crypto plugins, so the result equals digest() of the whole data.
+     */
+    class LocalDigest {
+    public:
+        explicit LocalDigest(const CryptoManager::DigestFunction digestFunction)
+            : m_digestFunction(digestFunction)
+        {
+            QCryptographicHash::Algorithm algorithm;
+            if (GetLocalAlgorithm(digestFunction, &algorithm)) {
+                m_hash.reset(new QCryptographicHash(algorithm));
+            } else if (digestFunction == CryptoManager::DigestGost_2012_256) {
+                streebog256_init(&m_streebog);
+            } else if (digestFunction == CryptoManager::DigestGost_2012_512) {
+                streebog512_init(&m_streebog);
+            }
+        }
+
+        static bool isSupported(const CryptoManager::DigestFunction digestFunction)
+        {
+            QCryptographicHash::Algorithm algorithm;
+            return GetLocalAlgorithm(digestFunction, &algorithm) or
+                digestFunction == CryptoManager::DigestGost_2012_256 or
+                digestFunction == CryptoManager::DigestGost_2012_512;
+        }
+
+        void addData(const char* data, const int size)
+        {
+            if (m_hash) {
+                m_hash->addData(data, size);
+            } else {
+                streebog512_update(&m_streebog, static_cast<size_t>(size),
+                                   reinterpret_cast<const uint8_t*>(data));
+            }
+        }
+
+        QByteArray result()
+        {
+            if (m_hash) {
+                return m_hash->result();
+            }
+
+            const bool is256 = m_digestFunction == CryptoManager::DigestGost_2012_256;
+            QByteArray digest(is256 ? STREEBOG256_DIGEST_SIZE : STREEBOG512_DIGEST_SIZE,
+                              Qt::Uninitialized);
+            uint8_t* const output = reinterpret_cast<uint8_t*>(digest.data());
+            if (is256) {
+                streebog256_digest(&m_streebog, digest.size(), output);
+            } else {
+                streebog512_digest(&m_streebog, digest.size(), output);
+            }
+            return digest;
+        }
+
+    private:
+        const CryptoManager::DigestFunction m_digestFunction;
+        std::unique_ptr<QCryptographicHash> m_hash;
+        streebog512_ctx m_streebog;
+    };
+
+    QByteArray ReadChunk(QIODevice* input, const qint64 chunkSize, bool* error)
+    {
+        const QByteArray chunk = input->read(chunkSize);
+        if (chunk.isEmpty() and not input->atEnd()) {
+            qDebug() << "Error when reading digest input:" << input->errorString();
+            *error = true;
+        }
+        return chunk;
+    }
+
+    QByteArray LocalDigestStream(QIODevice* input,
+                                 const CryptoManager::DigestFunction digestFunction,
+                                 const qint64 chunkSize)
+    {
+        LocalDigest hash(digestFunction);
+        bool error = false;
+
+        while (not input->atEnd()) {
+            const QByteArray chunk = ReadChunk(input, chunkSize, &error);
+            if (error) {
+                return {};
+            }
+            hash.addData(chunk.constData(), chunk.size());
+        }
+
+        return hash.result();
+    }
+
+    const char TREE_LEAF_PREFIX = 0x00;
+    const char TREE_NODE_PREFIX = 0x01;
+
+    /*
+      Digest of the data prefixed with one byte. Calculated in the process when the digest
+      function is supported by LocalDigest, otherwise by the daemon.
+     */
+    QByteArray PrefixedDigest(const char prefix,
+                              const char* data,
+                              const int size,
+                              const CryptoManager::DigestFunction digestFunction,
+                              const QString& pluginName)
+    {
+        if (LocalDigest::isSupported(digestFunction)) {
+            LocalDigest hash(digestFunction);
+            hash.addData(&prefix, 1);
+            hash.addData(data, size);
+            return hash.result();
+        }
+
+        QByteArray message;
+        message.reserve(size + 1);
+        message.append(prefix);
+        message.append(data, size);
+
+        CalculateDigestRequest request;
+        SetupDigestRequest(request, message, CryptoManager::SignaturePaddingNone,
+                           digestFunction, pluginName);
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            return {};
+        }
+
+        return request.digest();
+    }
+
+    /*
+      Hashes one leaf of the file. Every task opens and maps its own part of the file,
+      so tasks do not share any state except their result slot.
+     */
+    class LeafDigestTask : public QRunnable {
+    public:
+        LeafDigestTask(const QString& fileName,
+                       const qint64 offset,
+                       const qint64 size,
+                       const CryptoManager::DigestFunction digestFunction,
+                       const QString& pluginName,
+                       QByteArray* result,
+                       std::atomic<bool>* failed)
+            : m_fileName(fileName)
+            , m_offset(offset)
+            , m_size(size)
+            , m_digestFunction(digestFunction)
+            , m_pluginName(pluginName)
+            , m_result(result)
+            , m_failed(failed)
+        {
+        }
+
+        void run() override
+        {
+            if (m_failed->load()) {
+                return;
+            }
+
+            QFile file(m_fileName);
+            if (not file.open(QIODevice::ReadOnly)) {
+                qDebug() << "Error when opening digest input:" << file.errorString();
+                m_failed->store(true);
+                return;
+            }
+
+            const uchar* data = m_size > 0 ? file.map(m_offset, m_size) : nullptr;
+            if (m_size > 0 and not data) {
+                qDebug() << "Error when mapping digest input:" << file.errorString();
+                m_failed->store(true);
+                return;
+            }
+
+            *m_result = PrefixedDigest(TREE_LEAF_PREFIX,
+                                       reinterpret_cast<const char*>(data),
+                                       static_cast<int>(m_size),
+                                       m_digestFunction,
+                                       m_pluginName);
+            if (m_result->isEmpty()) {
+                m_failed->store(true);
+            }
+        }
+
+    private:
+        const QString m_fileName;
+        const qint64 m_offset;
+        const qint64 m_size;
+        const CryptoManager::DigestFunction m_digestFunction;
+        const QString m_pluginName;
+        QByteArray* const m_result;
+        std::atomic<bool>* const m_failed;
+    };
+
+} // anonymous namespace
+
 QByteArray DigestRequests::digest(
     const QByteArray& data,
     const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
     const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
     const QString& pluginName)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
+
+    MetricsScope metrics("digest", Metrics::digestName(digestFunction), pluginName, data.size());
+
+    if (CryptoPlugin* const plugin = LocalPlugins::plugin(pluginName)) {
+        QByteArray digest;
+        const Result result =
+            plugin->calculateDigest(data, padding, digestFunction, QVariantMap(), &digest);
+
+        if (not IsResultWasSuccessful(result)) {
+            return {};
+        }
 
-    CryptoManager manager;
+        metrics.setSucceeded(digest.size());
+        return digest;
+    }
+
+    trace.phase("setup");
     CalculateDigestRequest request;
-    request.setManager(&manager);
-    request.setPadding(padding);
-    request.setDigestFunction(digestFunction);
-    request.setCryptoPluginName(pluginName);
-    request.setData(data);
+    SetupDigestRequest(request, data, padding, digestFunction, pluginName);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         return {};
     }
 
-    return request.digest();
+    const QByteArray digest = request.digest();
+    metrics.setSucceeded(digest.size());
+    return digest;
+}
+
+bool DigestRequests::digest(
+    const ByteView& data,
+    QByteArray* digest,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+    const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+    const QString& pluginName)
+{
+    AssignToOutputBuffer(digest, DigestRequests::digest(data.toRawByteArray(), padding,
+                                                        digestFunction, pluginName));
+    return not digest->isEmpty();
+}
+
+QFuture<QByteArray> DigestRequests::digestAsync(
+    const QByteArray& data,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+    const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    CalculateDigestRequest* const request = new CalculateDigestRequest;
+    SetupDigestRequest(*request, data, padding, digestFunction, pluginName);
+
+    return StartAsyncRequest<QByteArray>(
+        request,
+        [] (const CalculateDigestRequest& finished) {
+            return finished.digest();
+        },
+        nullptr);
+}
+
+QByteArray DigestRequests::digestStream(
+    QIODevice* input,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+    const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+    const QString& pluginName,
+    const qint64 chunkSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    if (not input or not input->isReadable() or chunkSize <= 0) {
+        qDebug() << "Error when calculating digest: bad arguments";
+        return {};
+    }
+
+    // Digests are calculated in the process, the same as the plugins would.
+    Q_UNUSED(padding);
+    Q_UNUSED(pluginName);
+
+    if (not LocalDigest::isSupported(digestFunction)) {
+        qDebug() << "Error when calculating digest: streaming is not supported for"
+                 << digestFunction;
+        return {};
+    }
+
+    return LocalDigestStream(input, digestFunction, chunkSize);
+}
+
+QByteArray DigestRequests::digestFile(
+    const QString& fileName,
+    const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+    const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+    const QString& pluginName,
+    const qint64 chunkSize)
+{
+    MappedFile input(fileName);
+    if (not input.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error when opening digest input:" << input.errorString();
+        return {};
+    }
+
+    return digestStream(&input, padding, digestFunction, pluginName, chunkSize);
+}
+
+QByteArray DigestRequests::treeDigestFile(
+    const QString& fileName,
+    const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+    const QString& pluginName,
+    const qint64 leafSize,
+    const int threadCount)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    // Leaves are hashed with one call, so they must fit into int.
+    if (leafSize <= 0 or leafSize > std::numeric_limits<int>::max() - 1) {
+        qDebug() << "Error when calculating tree digest: bad leaf size";
+        return {};
+    }
+
+    const qint64 fileSize = QFile(fileName).size();
+    const qint64 leafCount = qMax<qint64>(1, (fileSize + leafSize - 1) / leafSize);
+
+    std::vector<QByteArray> nodes(leafCount);
+    std::atomic<bool> failed(false);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount > 0 ? threadCount : QThread::idealThreadCount());
+
+    for (qint64 i = 0; i < leafCount; ++i) {
+        const qint64 offset = i * leafSize;
+        pool.start(new LeafDigestTask(
+            fileName,
+            offset,
+            qMin(leafSize, fileSize - offset),
+            digestFunction,
+            pluginName,
+            &nodes[i],
+            &failed));
+    }
+
+    pool.waitForDone();
+
+    if (failed.load()) {
+        return {};
+    }
+
+    while (nodes.size() > 1) {
+        std::vector<QByteArray> level;
+        level.reserve((nodes.size() + 1) / 2);
+
+        for (std::size_t i = 0; i + 1 < nodes.size(); i += 2) {
+            const QByteArray pair = nodes[i] + nodes[i + 1];
+            level.push_back(PrefixedDigest(TREE_NODE_PREFIX, pair.constData(), pair.size(),
+                                           digestFunction, pluginName));
+            if (level.back().isEmpty()) {
+                return {};
+            }
+        }
+
+        if (nodes.size() % 2) {
+            level.push_back(nodes.back());
+        }
+
+        nodes.swap(level);
+    }
+
+    return nodes.front();
 }
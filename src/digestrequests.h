@@ -3,13 +3,86 @@
 #include "Crypto/cryptoglobal.h"
 #include "Crypto/request.h"
 
+#include <QtCore/QFuture>
+
+class QIODevice;
+class ByteView;
+
 class DigestRequests : public QObject {
     Q_OBJECT
 
 public:
+    static const qint64 DefaultChunkSize = 1024 * 1024;
+    static const qint64 DefaultLeafSize = 4 * 1024 * 1024;
+
     static QByteArray digest(
         const QByteArray& data,
         const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
         const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
         const QString& pluginName);
+
+    /*
+      Same as digest() for data in the caller's memory, it is passed to the request
+      without copying. Returns false on error, the digest is copied into the memory the
+      buffer already owns when it fits.
+     */
+    static bool digest(
+        const ByteView& data,
+        QByteArray* digest,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName);
+
+    static QFuture<QByteArray> digestAsync(
+        const QByteArray& data,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName);
+
+    /*
+      Calculates digest of the input reading it by chunks, so memory consumption does not
+      depend on the input size.
+      SHA-1, SHA-256, SHA-512 and GOST R 34.11-2012 (256 and 512 bit) are calculated
+      incrementally in the process and are the same as digest() of the whole input.
+      The daemon has no incremental digest, so other digest functions are an error.
+      Returns empty array on error.
+     */
+    static QByteArray digestStream(
+        QIODevice* input,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName,
+        const qint64 chunkSize = DefaultChunkSize);
+
+    /*
+      Same as digestStream() for the memory-mapped file.
+     */
+    static QByteArray digestFile(
+        const QString& fileName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName,
+        const qint64 chunkSize = DefaultChunkSize);
+
+    /*
+      Tree digest of the file. The file is split into leaves of leafSize bytes (the last
+      leaf may be shorter, empty file has one empty leaf) which are hashed concurrently
+      by threadCount workers (0 means QThread::idealThreadCount()).
+      Format of the tree, H is the digest function:
+        leaf(i) = H(0x00 + bytes of leaf i)
+        node = H(0x01 + left + right)
+      Nodes of every level are paired from left to right, an odd last node is moved
+      to the next level unchanged. The root node is the result.
+      The result depends on the leaf size, so the same leaf size must be used to compare
+      digests. It is not the same as digest() of the file.
+      SHA-1, SHA-256, SHA-512 and GOST R 34.11-2012 are calculated in the process, other
+      digest functions are calculated by the daemon with one request per tree node.
+      Returns empty array on error.
+     */
+    static QByteArray treeDigestFile(
+        const QString& fileName,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName,
+        const qint64 leafSize = DefaultLeafSize,
+        const int threadCount = 0);
 };
@@ -1,14 +1,75 @@
 #include "encryptdecryptrequests.h"
+#include "byteview.h"
+#include "securearena.h"
 #include "utils.h"
+#include "connections.h"
+#include "asyncrequest.h"
+#include "batchrequest.h"
+#include "localplugins.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/cryptomanager.h>
 #include <Sailfish/Crypto/encryptrequest.h>
 #include <Sailfish/Crypto/decryptrequest.h>
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
 
 #include <QtCore/QDebug>
 
 using namespace Sailfish::Crypto;
 
+namespace {
+
+    void SetupEncryptRequest(
+        EncryptRequest& request,
+        const Key& key,
+        const QByteArray& iv,
+        const QByteArray& plainText,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setData(plainText);
+        request.setKey(key);
+        request.setInitializationVector(iv);
+        request.setBlockMode(blockMode);
+        request.setPadding(padding);
+        request.setCryptoPluginName(pluginName);
+        if (not authCode.isEmpty()) {
+            request.setAuthenticationData(authCode);
+        }
+    }
+
+    void SetupDecryptRequest(
+        DecryptRequest& request,
+        const Key& key,
+        const QByteArray& iv,
+        const QByteArray& cipherText,
+        const CryptoManager::BlockMode blockMode,
+        const CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode,
+        const QByteArray* authTag)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setData(cipherText);
+        request.setKey(key);
+        request.setInitializationVector(iv);
+        request.setBlockMode(blockMode);
+        request.setPadding(padding);
+        request.setCryptoPluginName(pluginName);
+        if (not authCode.isEmpty()) {
+            request.setAuthenticationData(authCode);
+        }
+        if (authTag and not authTag->isEmpty()) {
+            request.setAuthenticationTag(*authTag);
+        }
+    }
+
+} // anonymous namespace
+
 QByteArray EncryptDecryptRequests::encrypt(
     const Sailfish::Crypto::Key& key,
     const QByteArray& iv,
@@ -19,37 +80,55 @@ QByteArray EncryptDecryptRequests::encrypt(
     const QByteArray& authCode,
     QByteArray* authTag) const
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
 
     if (not authCode.isEmpty() and not authTag) {
         throw std::runtime_error("Auth tag not specified when auth code is");
     }
 
-    CryptoManager manager;
-    EncryptRequest request;
-    request.setManager(&manager);
-    request.setData(plainText);
-    request.setKey(key);
-    request.setInitializationVector(iv);
-    request.setBlockMode(blockMode);
-    request.setPadding(padding);
-    request.setCryptoPluginName(pluginName);
-    if (not authCode.isEmpty()) {
-        request.setAuthenticationData(authCode);
+    MetricsScope metrics("encrypt", Metrics::algorithmName(key.algorithm()), pluginName,
+                         plainText.size() + authCode.size());
+
+    if (CryptoPlugin* const plugin = LocalPlugins::pluginForKey(key, pluginName)) {
+        QByteArray encrypted;
+        QByteArray tag;
+        const Result result = plugin->encrypt(
+            plainText, iv, key, blockMode, padding, authCode, QVariantMap(), &encrypted, &tag);
+
+        if (not IsResultWasSuccessful(result)) {
+            qDebug() << "Error when encrypt";
+            throw std::runtime_error("Error when encrypt");
+        }
+
+        if (authTag) {
+            *authTag = tag;
+        }
+
+        metrics.setSucceeded(encrypted.size());
+        return encrypted;
     }
+
+    trace.phase("setup");
+    EncryptRequest request;
+    SetupEncryptRequest(request, key, iv, plainText, blockMode, padding, pluginName, authCode);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         qDebug() << "Error when encrypt";
         throw std::runtime_error("Error when encrypt");
     }
 
-    if (not authCode.isEmpty()) {
+    if (authTag) {
         *authTag = request.authenticationTag();
     }
 
-    return request.ciphertext();
+    const QByteArray encrypted = request.ciphertext();
+    metrics.setSucceeded(encrypted.size());
+    return encrypted;
 }
 
 QByteArray EncryptDecryptRequests::decrypt(
@@ -62,30 +141,240 @@ QByteArray EncryptDecryptRequests::decrypt(
     const QByteArray& authCode,
     QByteArray* authTag) const
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
 
-    CryptoManager manager;
-    DecryptRequest request;
-    request.setManager(&manager);
-    request.setData(cipherText);
-    request.setKey(key);
-    request.setInitializationVector(iv);
-    request.setBlockMode(blockMode);
-    request.setPadding(padding);
-    request.setCryptoPluginName(pluginName);
-    if (not authCode.isEmpty()) {
-        request.setAuthenticationData(authCode);
+    MetricsScope metrics("decrypt", Metrics::algorithmName(key.algorithm()), pluginName,
+                         cipherText.size() + authCode.size());
+
+    // GCM plain text is never returned without a verified tag.
+    const bool verifyTag = blockMode == CryptoManager::BlockModeGcm;
+    if (verifyTag and (not authTag or authTag->isEmpty())) {
+        qDebug() << "Error when decrypt: authentication tag is required";
+        throw std::runtime_error("Error when decrypt");
     }
-    if (not authCode.isEmpty() and authTag) {
-        request.setAuthenticationTag(*authTag);
+
+    if (CryptoPlugin* const plugin = LocalPlugins::pluginForKey(key, pluginName)) {
+        QByteArray decrypted;
+        CryptoManager::VerificationStatus status = CryptoManager::VerificationStatusUnknown;
+        const Result result = plugin->decrypt(
+            cipherText, iv, key, blockMode, padding, authCode,
+            authTag ? *authTag : QByteArray(),
+            QVariantMap(), &decrypted, &status);
+
+        if (not IsResultWasSuccessful(result) or
+            (verifyTag and status != CryptoManager::VerificationSucceeded)) {
+            qDebug() << "Error when decrypt";
+            throw std::runtime_error("Error when decrypt");
+        }
+
+        metrics.setSucceeded(decrypted.size());
+        return decrypted;
     }
+
+    trace.phase("setup");
+    DecryptRequest request;
+    SetupDecryptRequest(request, key, iv, cipherText, blockMode, padding, pluginName, authCode, authTag);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
-    if (not IsRequestWasSuccessful(&request)) {
+    if (not IsRequestWasSuccessful(&request) or
+        (verifyTag and request.verificationStatus() != CryptoManager::VerificationSucceeded)) {
         qDebug() << "Error when decrypt";
         throw std::runtime_error("Error when decrypt");
     }
 
-    return request.plaintext();
+    const QByteArray decrypted = request.plaintext();
+    metrics.setSucceeded(decrypted.size());
+    return decrypted;
+}
+
+void EncryptDecryptRequests::encrypt(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& plainText,
+    QByteArray* cipherText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const QByteArray& authCode,
+    QByteArray* authTag) const
+{
+    AssignToOutputBuffer(cipherText, encrypt(key, iv, plainText.toRawByteArray(), blockMode,
+                                             padding, pluginName, authCode, authTag));
+}
+
+void EncryptDecryptRequests::decrypt(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& cipherText,
+    QByteArray* plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const QByteArray& authCode,
+    QByteArray* authTag) const
+{
+    AssignToOutputBuffer(plainText, decrypt(key, iv, cipherText.toRawByteArray(), blockMode,
+                                            padding, pluginName, authCode, authTag));
+}
+
+void EncryptDecryptRequests::decrypt(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const ByteView& cipherText,
+    SecureBuffer* plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const QByteArray& authCode,
+    QByteArray* authTag) const
+{
+    // The request is already destroyed, so the result is not shared and can be wiped.
+    QByteArray decrypted = decrypt(key, iv, cipherText.toRawByteArray(), blockMode, padding,
+                                   pluginName, authCode, authTag);
+    plainText->assignAndWipe(decrypted);
+}
+
+QFuture<EncryptDecryptRequests::EncryptedData> EncryptDecryptRequests::encryptAsync(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const QByteArray& plainText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const QByteArray& authCode) const
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    EncryptRequest* const request = new EncryptRequest;
+    SetupEncryptRequest(*request, key, iv, plainText, blockMode, padding, pluginName, authCode);
+
+    return StartAsyncRequest<EncryptedData>(
+        request,
+        [] (const EncryptRequest& finished) {
+            EncryptedData result;
+            result.cipherText = finished.ciphertext();
+            result.authTag = finished.authenticationTag();
+            return result;
+        },
+        "Error when encrypt");
+}
+
+QFuture<QByteArray> EncryptDecryptRequests::decryptAsync(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& iv,
+    const QByteArray& cipherText,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const QByteArray& authCode,
+    const QByteArray& authTag) const
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    DecryptRequest* const request = new DecryptRequest;
+    SetupDecryptRequest(*request, key, iv, cipherText, blockMode, padding, pluginName, authCode, &authTag);
+
+    // GCM plain text is never returned without a verified tag, whether there is
+    // authenticated data or not.
+    const bool verifyTag = blockMode == CryptoManager::BlockModeGcm;
+    const bool hasTag = not authTag.isEmpty();
+
+    return StartAsyncRequest<QByteArray>(
+        request,
+        [verifyTag, hasTag] (const DecryptRequest& finished) {
+            return not verifyTag or
+                (hasTag and finished.verificationStatus() == CryptoManager::VerificationSucceeded);
+        },
+        [] (const DecryptRequest& finished) {
+            return finished.plaintext();
+        },
+        "Error when decrypt");
+}
+
+QVector<EncryptDecryptRequests::BatchResult> EncryptDecryptRequests::encryptBatch(
+    const Sailfish::Crypto::Key& key,
+    const QVector<BatchItem>& items,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const int windowSize) const
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    const Key batchKey = CreateBatchKey(key);
+    QVector<BatchResult> results(items.size());
+
+    RunRequestBatch<EncryptRequest>(
+        items.size(),
+        windowSize,
+        [&] (const int index) {
+            const BatchItem& item = items.at(index);
+            EncryptRequest* const request = new EncryptRequest;
+            SetupEncryptRequest(*request, batchKey, item.iv, item.data,
+                                blockMode, padding, pluginName, item.authCode);
+            return request;
+        },
+        [&] (const int index, EncryptRequest& request) {
+            BatchResult& result = results[index];
+            result.succeeded = IsRequestWasSuccessful(&request);
+            if (result.succeeded) {
+                result.data = request.ciphertext();
+                result.authTag = request.authenticationTag();
+            } else {
+                result.errorMessage = request.result().errorMessage();
+            }
+        });
+
+    return results;
+}
+
+QVector<EncryptDecryptRequests::BatchResult> EncryptDecryptRequests::decryptBatch(
+    const Sailfish::Crypto::Key& key,
+    const QVector<BatchItem>& items,
+    const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+    const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+    const QString &pluginName,
+    const int windowSize) const
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    const Key batchKey = CreateBatchKey(key);
+    const bool verifyTag = blockMode == CryptoManager::BlockModeGcm;
+    QVector<BatchResult> results(items.size());
+
+    RunRequestBatch<DecryptRequest>(
+        items.size(),
+        windowSize,
+        [&] (const int index) {
+            const BatchItem& item = items.at(index);
+            DecryptRequest* const request = new DecryptRequest;
+            SetupDecryptRequest(*request, batchKey, item.iv, item.data,
+                                blockMode, padding, pluginName, item.authCode, &item.authTag);
+            return request;
+        },
+        [&] (const int index, DecryptRequest& request) {
+            const BatchItem& item = items.at(index);
+            BatchResult& result = results[index];
+            // Authenticated modes report a wrong tag by the verification status only,
+            // and GCM items without a tag are never accepted.
+            result.succeeded = IsRequestWasSuccessful(&request) and
+                (not verifyTag or
+                 (not item.authTag.isEmpty() and
+                  request.verificationStatus() == CryptoManager::VerificationSucceeded));
+            if (result.succeeded) {
+                result.data = request.plaintext();
+            } else if (IsRequestWasSuccessful(&request)) {
+                result.errorMessage = item.authTag.isEmpty()
+                    ? QStringLiteral("Authentication tag is missing")
+                    : QStringLiteral("Authentication tag verification failed");
+            } else {
+                result.errorMessage = request.result().errorMessage();
+            }
+        });
+
+    return results;
 }
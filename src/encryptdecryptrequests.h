@@ -2,10 +2,41 @@
 
 #include <Sailfish/Crypto/key.h>
 
+#include <QtCore/QFuture>
+#include <QtCore/QVector>
+
+class ByteView;
+class SecureBuffer;
+
 class EncryptDecryptRequests : public QObject {
     Q_OBJECT
 
 public:
+    static const int DefaultBatchWindowSize = 8;
+
+    struct EncryptedData {
+        QByteArray cipherText;
+        QByteArray authTag;
+    };
+
+    /*
+      Item of the batch. Data is the plain text for encryption and the cipher text for
+      decryption, auth tag is used only by decryption and is required with GCM.
+     */
+    struct BatchItem {
+        QByteArray iv;
+        QByteArray data;
+        QByteArray authCode;
+        QByteArray authTag;
+    };
+
+    struct BatchResult {
+        bool succeeded = false;
+        QByteArray data;
+        QByteArray authTag;
+        QString errorMessage;
+    };
+
     QByteArray encrypt(
         const Sailfish::Crypto::Key& key,
         const QByteArray& iv,
@@ -16,6 +47,9 @@ public:
         const QByteArray& authCode = "",
         QByteArray* authTag = nullptr) const;
 
+    /*
+      With BlockModeGcm authTag is required, decryption throws if it is not verified.
+     */
     QByteArray decrypt(
         const Sailfish::Crypto::Key& key,
         const QByteArray& iv,
@@ -25,4 +59,90 @@ public:
         const QString &pluginName,
         const QByteArray& authCode = "",
         QByteArray* authTag = nullptr) const;
+
+    /*
+      Same as encrypt() and decrypt() for input in the caller's memory, it is passed to
+      the request without copying. The reply is copied into the memory the output buffer
+      already owns when it fits (see AssignToOutputBuffer()), so reusing the buffer
+      avoids its allocation. The reply itself is still allocated by the client library.
+     */
+    void encrypt(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& plainText,
+        QByteArray* cipherText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr) const;
+
+    void decrypt(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& cipherText,
+        QByteArray* plainText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr) const;
+
+    /*
+      Same as decrypt(), but the plain text is kept in the locked memory of the buffer
+      and the copy returned by the request is wiped. Copies kept by the daemon client
+      library are not wiped.
+     */
+    void decrypt(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const ByteView& cipherText,
+        SecureBuffer* plainText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode = "",
+        QByteArray* authTag = nullptr) const;
+
+    QFuture<EncryptedData> encryptAsync(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const QByteArray& plainText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode = "") const;
+
+    /*
+      With BlockModeGcm the future fails unless authTag is given and verified.
+     */
+    QFuture<QByteArray> decryptAsync(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& iv,
+        const QByteArray& cipherText,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const QByteArray& authCode = "",
+        const QByteArray& authTag = QByteArray()) const;
+
+    /*
+      Encrypts all items with the same key keeping up to windowSize requests in flight.
+      Errors are reported for every item separately, nothing is thrown.
+     */
+    QVector<BatchResult> encryptBatch(
+        const Sailfish::Crypto::Key& key,
+        const QVector<BatchItem>& items,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const int windowSize = DefaultBatchWindowSize) const;
+
+    QVector<BatchResult> decryptBatch(
+        const Sailfish::Crypto::Key& key,
+        const QVector<BatchItem>& items,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const Sailfish::Crypto::CryptoManager::EncryptionPadding padding,
+        const QString &pluginName,
+        const int windowSize = DefaultBatchWindowSize) const;
 };
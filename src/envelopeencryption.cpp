@@ -0,0 +1,388 @@
+#include "envelopeencryption.h"
+#include "byteview.h"
+#include "envelopeformat.h"
+#include "securearena.h"
+#include "utils.h"
+#include "encryptdecryptrequests.h"
+#include "randompool.h"
+#include "trace.h"
+
+#include <QtCore/QAbstractEventDispatcher>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTimer>
+
+#include <climits>
+#include <list>
+#include <memory>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    const char ENVELOPE_MAGIC[] = "CEE1";
+    const int ENVELOPE_MAGIC_SIZE = 4;
+    const quint8 ENVELOPE_VERSION = 1;
+    const int GCM_IV_SIZE = 12;
+    const int GCM_TAG_SIZE = 16;
+
+    struct CacheEntry {
+        std::shared_ptr<SecureBuffer> dataKey;
+        qint64 insertedAt;
+        std::list<QByteArray>::iterator usage;
+    };
+
+    /*
+      Unwrapped data keys indexed by the wrapping key and the wrapped data key,
+      least recently used are evicted first.
+     */
+    struct DataKeyCache {
+        QMutex mutex;
+        QHash<QByteArray, CacheEntry> entries;
+        std::list<QByteArray> usage; // most recently used first
+        int capacity = EnvelopeEncryption::DefaultCacheCapacity;
+        qint64 timeToLive = EnvelopeEncryption::DefaultCacheTimeToLive;
+        qint64 purgeAt = 0; // when the scheduled purge is due, 0 if there is none
+    };
+
+    DataKeyCache& GetCache()
+    {
+        static DataKeyCache cache;
+        return cache;
+    }
+
+    QByteArray CreateCacheKey(const Key& wrappingKey, const QByteArray& wrappedKey)
+    {
+        return (wrappingKey.name() + QLatin1Char('/') + wrappingKey.collectionName() +
+                QLatin1Char('/') + wrappingKey.storagePluginName() + QLatin1Char('/')).toUtf8() +
+            wrappedKey;
+    }
+
+    void Remove(DataKeyCache& cache, QHash<QByteArray, CacheEntry>::iterator it)
+    {
+        cache.usage.erase(it->usage);
+        cache.entries.erase(it);
+    }
+
+    /*
+      Returns milliseconds until the next entry expires, -1 if the cache is empty.
+     */
+    qint64 RemoveExpired(DataKeyCache& cache)
+    {
+        const qint64 now = MonotonicMilliseconds();
+        qint64 nextExpiry = -1;
+        for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+            const qint64 timeLeft = cache.timeToLive - (now - it->insertedAt);
+            if (timeLeft < 0) {
+                cache.usage.erase(it->usage);
+                it = cache.entries.erase(it);
+            } else {
+                nextExpiry = nextExpiry < 0 ? timeLeft : qMin(nextExpiry, timeLeft);
+                ++it;
+            }
+        }
+        return nextExpiry;
+    }
+
+    void SchedulePurge(DataKeyCache& cache, const qint64 delay);
+
+    void PurgeExpired()
+    {
+        DataKeyCache& cache = GetCache();
+        QMutexLocker locker(&cache.mutex);
+        cache.purgeAt = 0;
+        SchedulePurge(cache, RemoveExpired(cache));
+    }
+
+    /*
+      Expired keys are removed by every insert and lookup, the timer wipes them when the
+      cache is not used. The timer runs in the event loop of the calling thread, so a
+      purge which is overdue (the thread has finished) or later than needed is scheduled
+      again.
+     */
+    void SchedulePurge(DataKeyCache& cache, const qint64 delay)
+    {
+        if (delay < 0 or not QAbstractEventDispatcher::instance()) {
+            return;
+        }
+
+        const qint64 now = MonotonicMilliseconds();
+        const qint64 timeout = qMin<qint64>(delay + 1, INT_MAX);
+        if (cache.purgeAt != 0 and cache.purgeAt >= now and cache.purgeAt <= now + timeout) {
+            return;
+        }
+
+        cache.purgeAt = now + timeout;
+        QTimer::singleShot(static_cast<int>(timeout), PurgeExpired);
+    }
+
+    void InsertDataKey(const QByteArray& cacheKey, const std::shared_ptr<SecureBuffer>& dataKey)
+    {
+        DataKeyCache& cache = GetCache();
+        QMutexLocker locker(&cache.mutex);
+
+        const qint64 nextExpiry = RemoveExpired(cache);
+
+        const auto it = cache.entries.find(cacheKey);
+        if (it != cache.entries.end()) {
+            Remove(cache, it);
+        }
+
+        while (not cache.entries.isEmpty() and cache.entries.size() >= cache.capacity) {
+            Remove(cache, cache.entries.find(cache.usage.back()));
+        }
+
+        if (cache.capacity <= 0) {
+            return;
+        }
+
+        cache.usage.push_front(cacheKey);
+
+        CacheEntry entry;
+        entry.dataKey = dataKey;
+        entry.insertedAt = MonotonicMilliseconds();
+        entry.usage = cache.usage.begin();
+        cache.entries.insert(cacheKey, entry);
+
+        SchedulePurge(cache, nextExpiry < 0 ? cache.timeToLive : qMin(nextExpiry, cache.timeToLive));
+    }
+
+    std::shared_ptr<SecureBuffer> FindDataKey(const QByteArray& cacheKey)
+    {
+        DataKeyCache& cache = GetCache();
+        QMutexLocker locker(&cache.mutex);
+
+        RemoveExpired(cache);
+
+        const auto it = cache.entries.find(cacheKey);
+        if (it == cache.entries.end()) {
+            return nullptr;
+        }
+
+        cache.usage.splice(cache.usage.begin(), cache.usage, it->usage);
+        return it->dataKey;
+    }
+
+    QByteArray TakeRandomBytes(const int count)
+    {
+        return RandomPool::threadPool()->takeBytes(count);
+    }
+
+    std::shared_ptr<SecureBuffer> CreateDataKey()
+    {
+        QByteArray data = TakeRandomBytes(EnvelopeEncryption::DataKeySize);
+        const auto dataKey = std::make_shared<SecureBuffer>();
+        dataKey->assignAndWipe(data);
+        return dataKey;
+    }
+
+    /*
+      Non-stored key for the data, so the payload is encrypted by a local plugin when
+      LocalPlugins is enabled. The copy of the key data lives as long as the Key.
+     */
+    Key CreatePayloadKey(const SecureBuffer& dataKey)
+    {
+        Key key;
+        key.setAlgorithm(CryptoManager::AlgorithmAes);
+        key.setSize(EnvelopeEncryption::DataKeySize * 8);
+        key.setOrigin(Key::OriginDevice);
+        key.setOperations(CryptoManager::OperationEncrypt | CryptoManager::OperationDecrypt);
+        key.setSecretKey(QByteArray(dataKey.constData(), dataKey.size()));
+        return key;
+    }
+
+    QByteArray CreateWrapAuthData()
+    {
+        QByteArray data(ENVELOPE_MAGIC, ENVELOPE_MAGIC_SIZE);
+        AppendUInt8(&data, ENVELOPE_VERSION);
+        return data;
+    }
+
+    struct ParsedEnvelope {
+        QByteArray header;
+        QByteArray wrapIV;
+        QByteArray wrapTag;
+        QByteArray wrappedKey;
+        QByteArray iv;
+        QByteArray tag;
+        QByteArray cipherText;
+    };
+
+    ParsedEnvelope ParseEnvelope(const ByteView& envelope)
+    {
+        EnvelopeReader reader(envelope);
+        const ByteView magic = reader.bytes(ENVELOPE_MAGIC_SIZE);
+        const quint8 version = reader.uint8();
+
+        ParsedEnvelope result;
+        result.wrapIV = reader.bytes(GCM_IV_SIZE).toRawByteArray();
+        result.wrapTag = reader.bytes(GCM_TAG_SIZE).toRawByteArray();
+        result.wrappedKey = reader.bytes(EnvelopeEncryption::DataKeySize).toRawByteArray();
+        result.iv = reader.bytes(GCM_IV_SIZE).toRawByteArray();
+
+        if (reader.hasError() or
+            qstrncmp(magic.data(), ENVELOPE_MAGIC, ENVELOPE_MAGIC_SIZE) != 0 or
+            version != ENVELOPE_VERSION or
+            envelope.size() - reader.offset() < GCM_TAG_SIZE) {
+            throw std::runtime_error("Bad envelope");
+        }
+
+        const int headerSize = reader.offset();
+        const int cipherTextSize = envelope.size() - headerSize - GCM_TAG_SIZE;
+        result.header = envelope.mid(0, headerSize).toRawByteArray();
+        result.cipherText = reader.bytes(cipherTextSize).toRawByteArray();
+        result.tag = reader.bytes(GCM_TAG_SIZE).toRawByteArray();
+        return result;
+    }
+
+    std::shared_ptr<SecureBuffer> UnwrapDataKey(
+        const Key& wrappingKey,
+        const ParsedEnvelope& envelope,
+        const QString& wrappingPluginName)
+    {
+        const QByteArray cacheKey = CreateCacheKey(wrappingKey, envelope.wrappedKey);
+        if (const auto dataKey = FindDataKey(cacheKey)) {
+            return dataKey;
+        }
+
+        QByteArray wrapTag = envelope.wrapTag;
+        const auto dataKey = std::make_shared<SecureBuffer>();
+        EncryptDecryptRequests().decrypt(
+            wrappingKey, envelope.wrapIV, ByteView(envelope.wrappedKey), dataKey.get(),
+            CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+            wrappingPluginName, CreateWrapAuthData(), &wrapTag);
+
+        if (dataKey->size() != EnvelopeEncryption::DataKeySize) {
+            throw std::runtime_error("Bad envelope data key");
+        }
+
+        InsertDataKey(cacheKey, dataKey);
+        return dataKey;
+    }
+
+    QByteArray DecryptPayload(
+        const Key& wrappingKey,
+        const ByteView& envelope,
+        const QString& wrappingPluginName,
+        const QString& pluginName)
+    {
+        const ParsedEnvelope parsed = ParseEnvelope(envelope);
+        const auto dataKey = UnwrapDataKey(wrappingKey, parsed, wrappingPluginName);
+
+        QByteArray tag = parsed.tag;
+        return EncryptDecryptRequests().decrypt(
+            CreatePayloadKey(*dataKey), parsed.iv, parsed.cipherText,
+            CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+            pluginName, parsed.header, &tag);
+    }
+
+} // anonymous namespace
+
+QByteArray EnvelopeEncryption::seal(
+    const Key& wrappingKey,
+    const ByteView& plainText,
+    const QString& wrappingPluginName,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    trace.phase("setup");
+    const auto dataKey = CreateDataKey();
+    const QByteArray wrapIV = TakeRandomBytes(GCM_IV_SIZE);
+    const QByteArray iv = TakeRandomBytes(GCM_IV_SIZE);
+
+    // The only call to the daemon.
+    trace.phase("wrap");
+    QByteArray wrapTag;
+    const QByteArray wrappedKey = EncryptDecryptRequests().encrypt(
+        wrappingKey, wrapIV, dataKey->view().toRawByteArray(),
+        CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+        wrappingPluginName, CreateWrapAuthData(), &wrapTag);
+
+    // All fields have fixed sizes, so none of them is stored.
+    if (wrapIV.size() != GCM_IV_SIZE or iv.size() != GCM_IV_SIZE or
+        wrapTag.size() != GCM_TAG_SIZE or wrappedKey.size() != EnvelopeEncryption::DataKeySize) {
+        throw std::runtime_error("Error when wrapping data key");
+    }
+
+    QByteArray header(ENVELOPE_MAGIC, ENVELOPE_MAGIC_SIZE);
+    AppendUInt8(&header, ENVELOPE_VERSION);
+    header.append(wrapIV);
+    header.append(wrapTag);
+    header.append(wrappedKey);
+    header.append(iv);
+
+    trace.phase("encrypt");
+    QByteArray tag;
+    const QByteArray cipherText = EncryptDecryptRequests().encrypt(
+        CreatePayloadKey(*dataKey), iv, plainText.toRawByteArray(),
+        CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+        pluginName, header, &tag);
+
+    if (tag.size() != GCM_TAG_SIZE) {
+        throw std::runtime_error("Error when encrypt");
+    }
+
+    // The object is likely to be opened soon, so its data key is cached right away.
+    InsertDataKey(CreateCacheKey(wrappingKey, wrappedKey), dataKey);
+
+    QByteArray envelope;
+    envelope.reserve(header.size() + cipherText.size() + tag.size());
+    envelope.append(header);
+    envelope.append(cipherText);
+    envelope.append(tag);
+    return envelope;
+}
+
+QByteArray EnvelopeEncryption::open(
+    const Key& wrappingKey,
+    const ByteView& envelope,
+    const QString& wrappingPluginName,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    return DecryptPayload(wrappingKey, envelope, wrappingPluginName, pluginName);
+}
+
+void EnvelopeEncryption::open(
+    const Key& wrappingKey,
+    const ByteView& envelope,
+    SecureBuffer* plainText,
+    const QString& wrappingPluginName,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    // The request is already destroyed, so the result is not shared and can be wiped.
+    QByteArray decrypted = DecryptPayload(wrappingKey, envelope, wrappingPluginName, pluginName);
+    plainText->assignAndWipe(decrypted);
+}
+
+void EnvelopeEncryption::setCacheCapacity(const int capacity)
+{
+    DataKeyCache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.capacity = capacity;
+
+    while (not cache.entries.isEmpty() and cache.entries.size() > cache.capacity) {
+        Remove(cache, cache.entries.find(cache.usage.back()));
+    }
+}
+
+void EnvelopeEncryption::setCacheTimeToLive(const qint64 timeToLive)
+{
+    DataKeyCache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.timeToLive = timeToLive;
+    SchedulePurge(cache, RemoveExpired(cache));
+}
+
+void EnvelopeEncryption::clearCache()
+{
+    DataKeyCache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.entries.clear();
+    cache.usage.clear();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QObject>
+
+class ByteView;
+class SecureBuffer;
+
+/*
+  Envelope encryption: every object is encrypted with its own random AES-256 data key,
+  and only the data key is encrypted (wrapped) with the stored key by the daemon.
+  The payload is encrypted with AES-GCM by a non-stored key, so with LocalPlugins
+  enabled it never leaves the process and the daemon is called once per object
+  instead of per byte. Unwrapped data keys are kept in SecureArena memory for a short
+  time, so opening the same object again does not call the daemon either. Expired keys
+  are wiped by every cache access and by a timer in the event loop of the thread which
+  used the cache last.
+  Envelope format, all fields but the cipher text have fixed sizes:
+    "CEE1", version (1), wrap IV (12), wrap tag (16), wrapped key (32), IV (12),
+    cipher text, tag (16).
+  Everything before the cipher text is authenticated together with the payload.
+ */
+class EnvelopeEncryption : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DataKeySize = 32;
+    static const int DefaultCacheCapacity = 256;
+    static const qint64 DefaultCacheTimeToLive = 60 * 1000; // milliseconds
+
+    /*
+      Throws std::runtime_error on error.
+     */
+    static QByteArray seal(
+        const Sailfish::Crypto::Key& wrappingKey,
+        const ByteView& plainText,
+        const QString& wrappingPluginName,
+        const QString& pluginName);
+
+    /*
+      Throws std::runtime_error on error, also if the envelope is not authentic.
+     */
+    static QByteArray open(
+        const Sailfish::Crypto::Key& wrappingKey,
+        const ByteView& envelope,
+        const QString& wrappingPluginName,
+        const QString& pluginName);
+
+    /*
+      Same as open(), but the plain text is kept in the locked memory of the buffer.
+      The payload key passed to the request is an ordinary copy of the data key.
+     */
+    static void open(
+        const Sailfish::Crypto::Key& wrappingKey,
+        const ByteView& envelope,
+        SecureBuffer* plainText,
+        const QString& wrappingPluginName,
+        const QString& pluginName);
+
+    static void setCacheCapacity(const int capacity);
+    static void setCacheTimeToLive(const qint64 timeToLive);
+
+    /*
+      Wipes all cached data keys, e.g. when the wrapping key is deleted or rotated.
+     */
+    static void clearCache();
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "byteview.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+/*
+  Big endian fields of the sealed message and envelope encryption formats.
+ */
+inline void AppendUInt8(QByteArray* data, const quint8 value)
+{
+    data->append(static_cast<char>(value));
+}
+
+inline void AppendUInt16(QByteArray* data, const quint16 value)
+{
+    uchar buffer[2];
+    qToBigEndian(value, buffer);
+    data->append(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+}
+
+inline void AppendUInt32(QByteArray* data, const quint32 value)
+{
+    uchar buffer[4];
+    qToBigEndian(value, buffer);
+    data->append(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+}
+
+/*
+  Bounds checked reader of an envelope, every read fails after the first error.
+ */
+class EnvelopeReader {
+public:
+    explicit EnvelopeReader(const ByteView& data)
+        : m_data(data)
+        , m_offset(0)
+        , m_error(false)
+    {
+    }
+
+    bool hasError() const { return m_error; }
+    int offset() const { return m_offset; }
+    bool atEnd() const { return m_offset == m_data.size(); }
+
+    ByteView bytes(const int size)
+    {
+        if (m_error or size < 0 or size > m_data.size() - m_offset) {
+            m_error = true;
+            return ByteView(nullptr, 0);
+        }
+
+        const ByteView result = m_data.mid(m_offset, size);
+        m_offset += size;
+        return result;
+    }
+
+    quint8 uint8()
+    {
+        const ByteView data = bytes(1);
+        return m_error ? 0 : static_cast<quint8>(data.data()[0]);
+    }
+
+    quint16 uint16()
+    {
+        const ByteView data = bytes(2);
+        return m_error ? 0 : qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data.data()));
+    }
+
+    quint32 uint32()
+    {
+        const ByteView data = bytes(4);
+        return m_error ? 0 : qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data.data()));
+    }
+
+private:
+    const ByteView m_data;
+    int m_offset;
+    bool m_error;
+};
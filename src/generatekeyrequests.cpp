@@ -1,8 +1,17 @@
 #include "generatekeyrequests.h"
 #include "utils.h"
+#include "connections.h"
+#include "asyncrequest.h"
+#include "keycache.h"
+#include "kdfcalibration.h"
+#include "metadatacache.h"
+#include "localplugins.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/generatestoredkeyrequest.h>
 #include <Sailfish/Crypto/generatekeyrequest.h>
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
 
 #include <QtCore/QDebug>
 
@@ -17,6 +26,71 @@ namespace {
         return result;
     }
 
+    /*
+      Key derivation need for improve key security.
+      Its used for iterable several times getting digest of the key using some salt
+      which defense from dictionary attacks.
+      The number of iterations is calibrated for the device and every key gets its own salt.
+    */
+    KeyDerivationParameters CreateKeyDerivationParams(
+        const CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength)
+    {
+        KeyDerivationParameters kdp;
+        kdp.setKeyDerivationFunction(CryptoManager::KdfPkcs5Pbkdf2);
+        kdp.setKeyDerivationMac(CryptoManager::MacHmac);
+        kdp.setKeyDerivationDigestFunction(digestFunction);
+        kdp.setIterations(KdfCalibration::iterations(digestFunction));
+        kdp.setSalt(KdfCalibration::createSalt());
+        kdp.setOutputKeySize(keyLength);
+        return kdp;
+    }
+
+    Key CreateKeyTemplate(
+        const CryptoManager::Algorithm algorithm,
+        const CryptoManager::Operations operations,
+        const std::size_t keyLength)
+    {
+        Key key;
+        key.setAlgorithm(algorithm);
+        key.setSize(keyLength);
+        key.setOrigin(Key::OriginDevice);
+        key.setOperations(operations);
+        key.setComponentConstraints(
+            Key::MetaData |
+            Key::PublicKeyData |
+            Key::PrivateKeyData);
+        return key;
+    }
+
+    bool IsKeyPairRequired(const Key& key)
+    {
+        return
+            (key.algorithm() == CryptoManager::AlgorithmRsa or
+             key.algorithm() == CryptoManager::AlgorithmGost) and
+            (key.operations() & CryptoManager::OperationSign or
+             key.operations() & CryptoManager::OperationVerify);
+    }
+
+    /*
+      GenerateStoredKeyRequest and GenerateKeyRequest are set up the same way.
+     */
+    template <typename GenerateRequest>
+    void SetupGenerateRequest(
+        GenerateRequest& request,
+        const Key& key,
+        const CryptoManager::DigestFunction digestFunction,
+        const QString& pluginName)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setKeyTemplate(key);
+        request.setCryptoPluginName(pluginName);
+        if (IsKeyPairRequired(key)) {
+            request.setKeyPairGenerationParameters(CreateGenParams(key.size()));
+        }
+        request.setKeyDerivationParameters(CreateKeyDerivationParams(digestFunction, key.size()));
+    }
+
 } // anonymous namespace
 
 Key GenerateKeyRequests::createStoredKey(
@@ -29,53 +103,33 @@ Key GenerateKeyRequests::createStoredKey(
     const std::size_t keyLength,
     const QString& pluginName)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
 
-    /*
-      Key derivation need for improve key security.
-      Its used for iterable several times getting digest of the key using some salt
-      which defense from dictionary attacks.
-    */
-    KeyDerivationParameters kdp;
-    kdp.setKeyDerivationFunction(CryptoManager::KdfPkcs5Pbkdf2);
-    kdp.setKeyDerivationMac(CryptoManager::MacHmac);
-    kdp.setKeyDerivationDigestFunction(digestFunction);
-    kdp.setIterations(16384);
-    kdp.setSalt("my random salt");
-    kdp.setOutputKeySize(keyLength);
-
-    Key key;
-    key.setAlgorithm(algorithm);
-    key.setSize(keyLength);
-    key.setOrigin(Key::OriginDevice);
-    key.setOperations(operations);
+    MetricsScope metrics("create_stored_key", Metrics::algorithmName(algorithm), pluginName);
+
+    Key key = CreateKeyTemplate(algorithm, operations, keyLength);
     key.setIdentifier(Key::Identifier(keyName, collectionName, dbName));
-    key.setComponentConstraints(
-        Key::MetaData |
-        Key::PublicKeyData |
-        Key::PrivateKeyData);
 
-    CryptoManager manager;
+    trace.phase("setup");
     GenerateStoredKeyRequest request;
-    request.setManager(&manager);
-    request.setKeyTemplate(key);
-    request.setCryptoPluginName(pluginName);
-    if ((algorithm == CryptoManager::AlgorithmRsa or
-         algorithm == CryptoManager::AlgorithmGost) and
-        (operations & CryptoManager::OperationSign or
-         operations & CryptoManager::OperationVerify)) {
-        request.setKeyPairGenerationParameters(CreateGenParams(key.size()));
-    }
-    request.setKeyDerivationParameters(kdp);
+    SetupGenerateRequest(request, key, digestFunction, pluginName);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         qDebug() << "Error when generating key";
         throw std::runtime_error("Error when generating key");
     }
 
-    return request.generatedKeyReference();
+    const Key reference = request.generatedKeyReference();
+    KeyCache::insert(reference, Key::MetaData);
+    MetadataCache::storedKeyCreated(reference.identifier());
+
+    metrics.setSucceeded();
+    return reference;
 }
 
 Key GenerateKeyRequests::createKey(
@@ -85,50 +139,97 @@ Key GenerateKeyRequests::createKey(
         const std::size_t keyLength,
         const QString& pluginName)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
+
+    MetricsScope metrics("create_key", Metrics::algorithmName(algorithm), pluginName);
+
+    const Key key = CreateKeyTemplate(algorithm, operations, keyLength);
+
+    if (CryptoPlugin* const plugin = LocalPlugins::plugin(pluginName)) {
+        Key generated;
+        const Result result = plugin->generateKey(
+            key,
+            IsKeyPairRequired(key) ?
+                KeyPairGenerationParameters(CreateGenParams(key.size())) :
+                KeyPairGenerationParameters(),
+            CreateKeyDerivationParams(digestFunction, key.size()),
+            QVariantMap(),
+            &generated);
+
+        if (not IsResultWasSuccessful(result)) {
+            qDebug() << "Error when generating key";
+            throw std::runtime_error("Error when generating key");
+        }
+
+        metrics.setSucceeded();
+        return generated;
+    }
 
-    /*
-      Key derivation need for improve key security.
-      Its used for iterable several times getting digest of the key using some salt
-      which defense from dictionary attacks.
-    */
-    KeyDerivationParameters kdp;
-    kdp.setKeyDerivationFunction(CryptoManager::KdfPkcs5Pbkdf2);
-    kdp.setKeyDerivationMac(CryptoManager::MacHmac);
-    kdp.setKeyDerivationDigestFunction(digestFunction);
-    kdp.setIterations(16384);
-    kdp.setSalt("my random salt");
-    kdp.setOutputKeySize(keyLength);
-
-    Key key;
-    key.setAlgorithm(algorithm);
-    key.setSize(keyLength);
-    key.setOrigin(Key::OriginDevice);
-    key.setOperations(operations);
-    key.setComponentConstraints(
-        Key::MetaData |
-        Key::PublicKeyData |
-        Key::PrivateKeyData);
-
-    CryptoManager manager;
+    trace.phase("setup");
     GenerateKeyRequest request;
-    request.setManager(&manager);
-    request.setKeyTemplate(key);
-    request.setCryptoPluginName(pluginName);
-    if ((algorithm == CryptoManager::AlgorithmRsa or
-         algorithm == CryptoManager::AlgorithmGost) and
-        (operations & CryptoManager::OperationSign or
-         operations & CryptoManager::OperationVerify)) {
-        request.setKeyPairGenerationParameters(CreateGenParams(key.size()));
-    }
-    request.setKeyDerivationParameters(kdp);
+    SetupGenerateRequest(request, key, digestFunction, pluginName);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         qDebug() << "Error when generating key";
         throw std::runtime_error("Error when generating key");
     }
 
+    metrics.setSucceeded();
     return request.generatedKey();
 }
+
+QFuture<Key> GenerateKeyRequests::createStoredKeyAsync(
+    const QString& keyName,
+    const QString& collectionName,
+    const QString& dbName,
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::Operations operations,
+    const CryptoManager::DigestFunction digestFunction,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    Key key = CreateKeyTemplate(algorithm, operations, keyLength);
+    key.setIdentifier(Key::Identifier(keyName, collectionName, dbName));
+
+    GenerateStoredKeyRequest* const request = new GenerateStoredKeyRequest;
+    SetupGenerateRequest(*request, key, digestFunction, pluginName);
+
+    return StartAsyncRequest<Key>(
+        request,
+        [] (const GenerateStoredKeyRequest& finished) {
+            const Key reference = finished.generatedKeyReference();
+            KeyCache::insert(reference, Key::MetaData);
+            MetadataCache::storedKeyCreated(reference.identifier());
+            return reference;
+        },
+        "Error when generating key");
+}
+
+QFuture<Key> GenerateKeyRequests::createKeyAsync(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::Operations operations,
+    const CryptoManager::DigestFunction digestFunction,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    const Key key = CreateKeyTemplate(algorithm, operations, keyLength);
+
+    GenerateKeyRequest* const request = new GenerateKeyRequest;
+    SetupGenerateRequest(*request, key, digestFunction, pluginName);
+
+    return StartAsyncRequest<Key>(
+        request,
+        [] (const GenerateKeyRequest& finished) {
+            return finished.generatedKey();
+        },
+        "Error when generating key");
+}
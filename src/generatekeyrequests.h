@@ -3,6 +3,8 @@
 #include <Sailfish/Crypto/key.h>
 #include <Sailfish/Crypto/cryptomanager.h>
 
+#include <QtCore/QFuture>
+
 namespace Sailfish {
     namespace Crypto {
         class Request;
@@ -29,4 +31,21 @@ public:
         const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
         const std::size_t keyLength,
         const QString& pluginName);
+
+    static QFuture<Sailfish::Crypto::Key> createStoredKeyAsync(
+        const QString& keyName,
+        const QString& collectionName,
+        const QString& dbName,
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::Operations operations,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength,
+        const QString& pluginName);
+
+    static QFuture<Sailfish::Crypto::Key> createKeyAsync(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::Operations operations,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength,
+        const QString& pluginName);
 };
@@ -0,0 +1,227 @@
+#include "ivpool.h"
+#include "utils.h"
+#include "connections.h"
+#include "createivrequests.h"
+
+#include <Sailfish/Crypto/generateinitializationvectorrequest.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include <memory>
+
+using namespace Sailfish::Crypto;
+
+IVPool::IVPool(const int lowWatermark,
+               const int highWatermark,
+               QObject* parent)
+    : QObject(parent)
+    , m_lowWatermark(lowWatermark)
+    , m_highWatermark(qMax(lowWatermark, highWatermark))
+{
+}
+
+QByteArray IVPool::takeIV(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::BlockMode blockMode,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        QString poolKey;
+        if (getPool(algorithm, blockMode, keyLength, pluginName, &poolKey).ivs.isEmpty()) {
+            ++m_statistics.misses;
+            scheduleRefill(m_pools[poolKey], poolKey);
+            waitForRefill(locker, poolKey);
+        } else {
+            ++m_statistics.hits;
+        }
+
+        Pool& pool = m_pools[poolKey];
+
+        QByteArray iv;
+        if (not pool.ivs.isEmpty()) {
+            iv = pool.ivs.dequeue();
+        }
+
+        if (pool.ivs.size() < m_lowWatermark) {
+            scheduleRefill(pool, poolKey);
+        }
+
+        if (not iv.isEmpty()) {
+            return iv;
+        }
+    }
+
+    // The refill failed, the synchronous request reports the error.
+    return CreateIVRequests::createIV(algorithm, blockMode, keyLength, pluginName);
+}
+
+void IVPool::prefill(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::BlockMode blockMode,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString poolKey;
+    Pool& pool = getPool(algorithm, blockMode, keyLength, pluginName, &poolKey);
+    scheduleRefill(pool, poolKey);
+}
+
+void IVPool::setWatermarks(const int lowWatermark, const int highWatermark)
+{
+    QMutexLocker locker(&m_mutex);
+    m_lowWatermark = lowWatermark;
+    m_highWatermark = qMax(lowWatermark, highWatermark);
+}
+
+IVPool::Statistics IVPool::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+IVPool::Pool& IVPool::getPool(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::BlockMode blockMode,
+    const std::size_t keyLength,
+    const QString& pluginName,
+    QString* poolKey)
+{
+    *poolKey = QStringLiteral("%1/%2/%3/%4")
+        .arg(static_cast<int>(algorithm))
+        .arg(static_cast<int>(blockMode))
+        .arg(keyLength)
+        .arg(pluginName);
+
+    auto it = m_pools.find(*poolKey);
+    if (it == m_pools.end()) {
+        Pool pool;
+        pool.algorithm = algorithm;
+        pool.blockMode = blockMode;
+        pool.keyLength = keyLength;
+        pool.pluginName = pluginName;
+        it = m_pools.insert(*poolKey, pool);
+    }
+
+    return *it;
+}
+
+/*
+  Refill is always started through the event loop of the pool's thread,
+  so takeIV() may be called from any thread. Must be called with the mutex locked.
+ */
+void IVPool::scheduleRefill(Pool& pool, const QString& poolKey)
+{
+    if (pool.refillScheduled) {
+        return;
+    }
+
+    pool.refillScheduled = true;
+    QMetaObject::invokeMethod(this, "refill", Qt::QueuedConnection, Q_ARG(QString, poolKey));
+}
+
+/*
+  Waits until the pool has an IV or its refill is over. Must be called with the
+  mutex locked by locker, references to pools are invalid after the call.
+ */
+void IVPool::waitForRefill(QMutexLocker& locker, const QString& poolKey)
+{
+    const auto isRefilling = [this, &poolKey] () {
+        const Pool& pool = m_pools[poolKey];
+        return pool.ivs.isEmpty() and (pool.refillScheduled or pool.requestsInFlight > 0);
+    };
+
+    if (QThread::currentThread() != thread()) {
+        while (isRefilling()) {
+            m_refilledCondition.wait(&m_mutex);
+        }
+        return;
+    }
+
+    // Refill requests finish in this thread, so its events are processed while waiting.
+    QEventLoop loop;
+    connect(this, &IVPool::refilled, &loop, &QEventLoop::quit);
+    while (isRefilling()) {
+        locker.unlock();
+        loop.exec();
+        locker.relock();
+    }
+}
+
+void IVPool::refill(const QString& poolKey)
+{
+    QVector<GenerateInitializationVectorRequest*> requests;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        Pool& pool = m_pools[poolKey];
+        pool.refillScheduled = false;
+
+        const int missing = m_highWatermark - pool.ivs.size() - pool.requestsInFlight;
+        for (int i = 0; i < missing; ++i) {
+            GenerateInitializationVectorRequest* const request = new GenerateInitializationVectorRequest;
+            request->setManager(Connections::cryptoManager());
+            request->setAlgorithm(pool.algorithm);
+            request->setKeySize(pool.keyLength);
+            request->setBlockMode(pool.blockMode);
+            request->setCryptoPluginName(pool.pluginName);
+            requests.append(request);
+        }
+
+        pool.requestsInFlight += requests.size();
+    }
+
+    if (requests.isEmpty()) {
+        m_refilledCondition.wakeAll();
+        emit refilled();
+        return;
+    }
+
+    // Requests are started without the lock, a request may finish synchronously.
+    for (GenerateInitializationVectorRequest* const request : requests) {
+        std::shared_ptr<QElapsedTimer> timer(new QElapsedTimer);
+        timer->start();
+
+        connect(request, &GenerateInitializationVectorRequest::statusChanged, this,
+                [this, request, poolKey, timer] () {
+            if (request->status() != Request::Finished) {
+                return;
+            }
+
+            const bool succeeded = IsRequestWasSuccessful(request);
+            const qint64 latency = timer->elapsed();
+
+            QMutexLocker locker(&m_mutex);
+            Pool& pool = m_pools[poolKey];
+            --pool.requestsInFlight;
+
+            ++m_statistics.refillRequests;
+            m_statistics.totalRefillLatency += latency;
+            m_statistics.maxRefillLatency = qMax(m_statistics.maxRefillLatency, latency);
+
+            if (succeeded) {
+                pool.ivs.enqueue(request->generatedInitializationVector());
+            } else {
+                ++m_statistics.refillErrors;
+            }
+
+            m_refilledCondition.wakeAll();
+            locker.unlock();
+
+            request->deleteLater();
+            emit refilled();
+        });
+
+        request->startRequest();
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QWaitCondition>
+
+/*
+  Pool of pre-generated initialization vectors.
+  There is a separate pool for every (algorithm, block mode, key size, plugin).
+  When a pool falls below the low watermark, it is refilled in the background up to
+  the high watermark with a burst of GenerateInitializationVectorRequest requests
+  which are in flight together. When the pool is empty, takeIV() waits for the
+  first IV of the refill instead of issuing one more request, and falls back to the
+  synchronous CreateIVRequests::createIV() only if the whole refill failed.
+  The pool may be used from any thread, refill requests are run in the thread the
+  pool belongs to, that thread must run an event loop. When takeIV() waits in that
+  thread, it runs a local event loop.
+ */
+class IVPool : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultLowWatermark = 16;
+    static const int DefaultHighWatermark = 64;
+
+    struct Statistics {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 refillRequests = 0;
+        quint64 refillErrors = 0;
+        qint64 totalRefillLatency = 0; // milliseconds
+        qint64 maxRefillLatency = 0; // milliseconds
+    };
+
+    explicit IVPool(const int lowWatermark = DefaultLowWatermark,
+                    const int highWatermark = DefaultHighWatermark,
+                    QObject* parent = nullptr);
+
+    QByteArray takeIV(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const std::size_t keyLength,
+        const QString& pluginName);
+
+    /*
+      Starts filling the pool for given parameters without taking anything from it.
+     */
+    void prefill(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const std::size_t keyLength,
+        const QString& pluginName);
+
+    void setWatermarks(const int lowWatermark, const int highWatermark);
+
+    Statistics statistics() const;
+
+signals:
+    /*
+      Emitted in the pool's thread when a refill request is finished.
+     */
+    void refilled();
+
+private slots:
+    void refill(const QString& poolKey);
+
+private:
+    struct Pool {
+        Sailfish::Crypto::CryptoManager::Algorithm algorithm;
+        Sailfish::Crypto::CryptoManager::BlockMode blockMode;
+        std::size_t keyLength;
+        QString pluginName;
+        QQueue<QByteArray> ivs;
+        int requestsInFlight = 0;
+        bool refillScheduled = false;
+    };
+
+    Pool& getPool(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::BlockMode blockMode,
+        const std::size_t keyLength,
+        const QString& pluginName,
+        QString* poolKey);
+
+    void scheduleRefill(Pool& pool, const QString& poolKey);
+    void waitForRefill(QMutexLocker& locker, const QString& poolKey);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_refilledCondition;
+    QHash<QString, Pool> m_pools;
+    int m_lowWatermark;
+    int m_highWatermark;
+    Statistics m_statistics;
+};
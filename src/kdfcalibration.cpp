@@ -0,0 +1,221 @@
+#include "kdfcalibration.h"
+#include "utils.h"
+#include "connections.h"
+#include "randompool.h"
+
+#include <Sailfish/Crypto/generatekeyrequest.h>
+#include <Sailfish/Crypto/keyderivationparameters.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSettings>
+
+#include <cmath>
+#include <limits>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    const int PROBE_ITERATIONS = 4096;
+    const int PROBE_SCALE = 4;
+    const int PROBE_RUNS = 3;
+    const int ITERATIONS_GRANULARITY = 1024;
+    const int CALIBRATION_KEY_LENGTH = 256;
+
+    struct Profiles {
+        QMutex mutex;
+        QHash<int, KdfCalibration::Profile> profiles;
+    };
+
+    Profiles& GetProfiles()
+    {
+        static Profiles profiles;
+        return profiles;
+    }
+
+    QString SettingsGroup(const CryptoManager::DigestFunction digestFunction)
+    {
+        return QStringLiteral("kdf/digest%1").arg(static_cast<int>(digestFunction));
+    }
+
+    bool LoadProfile(const CryptoManager::DigestFunction digestFunction,
+                     KdfCalibration::Profile* profile)
+    {
+        QSettings settings(QStringLiteral("cryptos"), QStringLiteral("cryptos"));
+        settings.beginGroup(SettingsGroup(digestFunction));
+
+        const int iterations = settings.value(QStringLiteral("iterations")).toInt();
+        if (iterations < KdfCalibration::MinimumIterations or
+            iterations > KdfCalibration::MaximumIterations) {
+            return false;
+        }
+
+        profile->digestFunction = digestFunction;
+        profile->iterations = iterations;
+        profile->targetLatency = settings.value(QStringLiteral("targetLatency")).toLongLong();
+        profile->iterationCost = settings.value(QStringLiteral("iterationCost")).toDouble();
+        return true;
+    }
+
+    void SaveProfile(const KdfCalibration::Profile& profile)
+    {
+        QSettings settings(QStringLiteral("cryptos"), QStringLiteral("cryptos"));
+        settings.beginGroup(SettingsGroup(profile.digestFunction));
+        settings.setValue(QStringLiteral("iterations"), profile.iterations);
+        settings.setValue(QStringLiteral("targetLatency"), profile.targetLatency);
+        settings.setValue(QStringLiteral("iterationCost"), profile.iterationCost);
+    }
+
+    /*
+      Calibration derives a throwaway key from random input data, so the plugin does
+      not ask the user for a passphrase.
+     */
+    qint64 MeasureDerivation(const CryptoManager::DigestFunction digestFunction,
+                             const int iterations,
+                             const QByteArray& inputData,
+                             const QString& pluginName)
+    {
+        Key key;
+        key.setAlgorithm(CryptoManager::AlgorithmAes);
+        key.setSize(CALIBRATION_KEY_LENGTH);
+        key.setOrigin(Key::OriginDevice);
+        key.setOperations(CryptoManager::OperationEncrypt);
+
+        KeyDerivationParameters kdp;
+        kdp.setKeyDerivationFunction(CryptoManager::KdfPkcs5Pbkdf2);
+        kdp.setKeyDerivationMac(CryptoManager::MacHmac);
+        kdp.setKeyDerivationDigestFunction(digestFunction);
+        kdp.setIterations(iterations);
+        kdp.setSalt(KdfCalibration::createSalt());
+        kdp.setInputData(inputData);
+        kdp.setOutputKeySize(CALIBRATION_KEY_LENGTH);
+
+        GenerateKeyRequest request;
+        request.setManager(Connections::cryptoManager());
+        request.setKeyTemplate(key);
+        request.setKeyDerivationParameters(kdp);
+        request.setCryptoPluginName(pluginName);
+
+        QElapsedTimer timer;
+        timer.start();
+        request.startRequest();
+        request.waitForFinished();
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            qDebug() << "Error when calibrating key derivation";
+            throw std::runtime_error("Error when calibrating key derivation");
+        }
+
+        return elapsed;
+    }
+
+    /*
+      The fastest of several runs is the least disturbed by the rest of the system.
+     */
+    qint64 MeasureBestDerivation(const CryptoManager::DigestFunction digestFunction,
+                                 const int iterations,
+                                 const QByteArray& inputData,
+                                 const QString& pluginName)
+    {
+        qint64 best = std::numeric_limits<qint64>::max();
+        for (int i = 0; i < PROBE_RUNS; ++i) {
+            best = qMin(best, MeasureDerivation(digestFunction, iterations, inputData, pluginName));
+        }
+        return best;
+    }
+
+} // anonymous namespace
+
+KdfCalibration::Profile KdfCalibration::profile(const CryptoManager::DigestFunction digestFunction)
+{
+    Profiles& profiles = GetProfiles();
+    QMutexLocker locker(&profiles.mutex);
+
+    const auto it = profiles.profiles.constFind(digestFunction);
+    if (it != profiles.profiles.constEnd()) {
+        return *it;
+    }
+
+    Profile result;
+    result.digestFunction = digestFunction;
+    LoadProfile(digestFunction, &result);
+    profiles.profiles.insert(digestFunction, result);
+    return result;
+}
+
+int KdfCalibration::iterations(const CryptoManager::DigestFunction digestFunction)
+{
+    return profile(digestFunction).iterations;
+}
+
+/*
+  Derivation time is t(n) = overhead + n * cost, where overhead is the request round
+  trip and key generation. Measuring two iteration counts cancels the overhead out.
+ */
+KdfCalibration::Profile KdfCalibration::calibrate(
+    const CryptoManager::DigestFunction digestFunction,
+    const qint64 targetLatency,
+    const QString& pluginName)
+{
+    qDebug() << Q_FUNC_INFO;
+
+    const QByteArray inputData = createSalt();
+    const qint64 small = MeasureBestDerivation(
+        digestFunction, PROBE_ITERATIONS, inputData, pluginName);
+    const qint64 large = MeasureBestDerivation(
+        digestFunction, PROBE_ITERATIONS * PROBE_SCALE, inputData, pluginName);
+
+    double iterationCost =
+        static_cast<double>(large - small) / (PROBE_ITERATIONS * (PROBE_SCALE - 1));
+    if (iterationCost <= 0) {
+        iterationCost = static_cast<double>(large) / (PROBE_ITERATIONS * PROBE_SCALE);
+    }
+
+    const double iterations = qBound(
+        static_cast<double>(MinimumIterations),
+        std::floor(targetLatency * 1e6 / iterationCost / ITERATIONS_GRANULARITY) *
+            ITERATIONS_GRANULARITY,
+        static_cast<double>(MaximumIterations));
+
+    Profile result;
+    result.digestFunction = digestFunction;
+    result.iterations = static_cast<int>(iterations);
+    result.targetLatency = targetLatency;
+    result.iterationCost = iterationCost;
+
+    setProfile(result);
+
+    qDebug() << "Key derivation calibrated:" << result.iterations << "iterations";
+
+    return result;
+}
+
+void KdfCalibration::setProfile(const Profile& profile)
+{
+    Profiles& profiles = GetProfiles();
+    QMutexLocker locker(&profiles.mutex);
+
+    profiles.profiles.insert(profile.digestFunction, profile);
+    SaveProfile(profile);
+}
+
+void KdfCalibration::reset()
+{
+    Profiles& profiles = GetProfiles();
+    QMutexLocker locker(&profiles.mutex);
+
+    profiles.profiles.clear();
+
+    QSettings settings(QStringLiteral("cryptos"), QStringLiteral("cryptos"));
+    settings.remove(QStringLiteral("kdf"));
+}
+
+QByteArray KdfCalibration::createSalt()
+{
+    return RandomPool::threadPool()->takeBytes(SaltSize);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+/*
+  PBKDF2 parameters tuned for the running device.
+  Calibration measures the cost of one PBKDF2 iteration for a digest function and
+  picks the number of iterations which takes the target latency. The result is
+  persisted per digest function, so calibration is needed only once per device.
+  Until a digest function is calibrated, DefaultIterations are used.
+ */
+class KdfCalibration : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultIterations = 16384;
+    static const int MinimumIterations = 4096;
+    static const int MaximumIterations = 16 * 1024 * 1024;
+    static const int SaltSize = 16;
+    static const qint64 DefaultTargetLatency = 250; // milliseconds
+
+    struct Profile {
+        Sailfish::Crypto::CryptoManager::DigestFunction digestFunction =
+            Sailfish::Crypto::CryptoManager::DigestSha256;
+        int iterations = DefaultIterations;
+        qint64 targetLatency = 0; // milliseconds, 0 if not calibrated
+        double iterationCost = 0; // nanoseconds
+    };
+
+    static Profile profile(const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+    static int iterations(const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    /*
+      Measures key derivation with probe iterations on the crypto plugin, stores and
+      returns the new profile. Takes a few times the probe derivation cost.
+      Throws std::runtime_error if key derivation fails.
+     */
+    static Profile calibrate(
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const qint64 targetLatency = DefaultTargetLatency,
+        const QString& pluginName = Sailfish::Crypto::CryptoManager::DefaultCryptoPluginName);
+
+    static void setProfile(const Profile& profile);
+
+    /*
+      Forgets all calibrated profiles, persisted ones too.
+     */
+    static void reset();
+
+    /*
+      New random salt of SaltSize bytes from RandomPool::threadPool().
+      Throws std::runtime_error if random data can't be generated.
+     */
+    static QByteArray createSalt();
+};
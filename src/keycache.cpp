@@ -0,0 +1,210 @@
+#include "keycache.h"
+#include "utils.h"
+#include "connections.h"
+
+#include <Sailfish/Crypto/storedkeyrequest.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include <list>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    /*
+      Private and secret key data is never cached, requests for it always go to
+      the daemon and only the rest of the components is put to the cache.
+     */
+    const Key::Components SECRET_COMPONENTS = Key::PrivateKeyData | Key::SecretKeyData;
+
+    struct Entry {
+        Key key;
+        Key::Components components;
+        qint64 insertedAt;
+        std::list<QString>::iterator usage;
+    };
+
+    struct Cache {
+        QMutex mutex;
+        QHash<QString, Entry> entries;
+        std::list<QString> usage; // most recently used first
+        int capacity = KeyCache::DefaultCapacity;
+        qint64 timeToLive = KeyCache::DefaultTimeToLive;
+    };
+
+    Cache& GetCache()
+    {
+        static Cache cache;
+        return cache;
+    }
+
+    QString CreateCacheKey(const QString& name,
+                           const QString& collectionName,
+                           const QString& storagePluginName)
+    {
+        return name + QLatin1Char('/') + collectionName + QLatin1Char('/') + storagePluginName;
+    }
+
+    QString CreateCacheKey(const Key::Identifier& identifier)
+    {
+        return CreateCacheKey(identifier.name(),
+                              identifier.collectionName(),
+                              identifier.storagePluginName());
+    }
+
+    void Remove(Cache& cache, QHash<QString, Entry>::iterator it)
+    {
+        cache.usage.erase(it->usage);
+        cache.entries.erase(it);
+    }
+
+    void Insert(Cache& cache,
+                const QString& cacheKey,
+                const Key& key,
+                const Key::Components components)
+    {
+        const auto it = cache.entries.find(cacheKey);
+        if (it != cache.entries.end()) {
+            Remove(cache, it);
+        }
+
+        while (not cache.entries.isEmpty() and cache.entries.size() >= cache.capacity) {
+            Remove(cache, cache.entries.find(cache.usage.back()));
+        }
+
+        if (cache.capacity <= 0) {
+            return;
+        }
+
+        cache.usage.push_front(cacheKey);
+
+        Entry entry;
+        entry.key = key;
+        entry.key.setPrivateKey(QByteArray());
+        entry.key.setSecretKey(QByteArray());
+        entry.components = components & ~SECRET_COMPONENTS;
+        entry.insertedAt = MonotonicMilliseconds();
+        entry.usage = cache.usage.begin();
+        cache.entries.insert(cacheKey, entry);
+    }
+
+    Key FetchStoredKey(const Key::Identifier& identifier,
+                       const Key::Components components)
+    {
+        StoredKeyRequest request;
+        request.setManager(Connections::cryptoManager());
+        request.setIdentifier(identifier);
+        request.setKeyComponents(components);
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            qDebug() << "Error when getStoredKey";
+            throw std::runtime_error("Error when getStoredKey");
+        }
+
+        return request.storedKey();
+    }
+
+} // anonymous namespace
+
+Key KeyCache::storedKey(const Key::Identifier& identifier,
+                        const Key::Components components)
+{
+    Cache& cache = GetCache();
+    const QString cacheKey = CreateCacheKey(identifier);
+    Key::Components fetchComponents = components;
+
+    {
+        QMutexLocker locker(&cache.mutex);
+
+        const auto it = cache.entries.find(cacheKey);
+        if (it != cache.entries.end()) {
+            if (MonotonicMilliseconds() - it->insertedAt > cache.timeToLive) {
+                Remove(cache, it);
+            } else if ((it->components & components) == components) {
+                cache.usage.splice(cache.usage.begin(), cache.usage, it->usage);
+                return it->key;
+            } else {
+                // Fetch the union, so callers of both component sets are served.
+                fetchComponents |= it->components;
+            }
+        }
+    }
+
+    // The daemon is asked without holding the lock.
+    const Key key = FetchStoredKey(identifier, fetchComponents);
+
+    QMutexLocker locker(&cache.mutex);
+    Insert(cache, cacheKey, key, fetchComponents);
+
+    return key;
+}
+
+void KeyCache::insert(const Key& key, const Key::Components components)
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    Insert(cache,
+           CreateCacheKey(key.name(), key.collectionName(), key.storagePluginName()),
+           key,
+           components);
+}
+
+void KeyCache::invalidate(const Key::Identifier& identifier)
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+
+    const auto it = cache.entries.find(CreateCacheKey(identifier));
+    if (it != cache.entries.end()) {
+        Remove(cache, it);
+    }
+}
+
+void KeyCache::invalidateCollection(const QString& collectionName,
+                                    const QString& storagePluginName)
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+
+    for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+        if (it->key.collectionName() == collectionName and
+            it->key.storagePluginName() == storagePluginName) {
+            cache.usage.erase(it->usage);
+            it = cache.entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void KeyCache::clear()
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.entries.clear();
+    cache.usage.clear();
+}
+
+void KeyCache::setCapacity(const int capacity)
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.capacity = capacity;
+
+    while (not cache.entries.isEmpty() and cache.entries.size() > cache.capacity) {
+        Remove(cache, cache.entries.find(cache.usage.back()));
+    }
+}
+
+void KeyCache::setTimeToLive(const qint64 timeToLive)
+{
+    Cache& cache = GetCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.timeToLive = timeToLive;
+}
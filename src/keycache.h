@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Sailfish/Crypto/key.h>
+
+/*
+  In-process cache of stored keys indexed by key identifier
+  (name, collection name, storage plugin name).
+  Only the requested key components are fetched from the daemon. Private and secret
+  key data is never cached, keys with them are always fetched. Entries are evicted
+  when the cache is full (least recently used first), when their time to live is
+  expired or explicitly when the key or its collection is deleted.
+ */
+class KeyCache : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultCapacity = 64;
+    static const qint64 DefaultTimeToLive = 5 * 60 * 1000; // milliseconds
+
+    /*
+      Returns the key from the cache if it contains all requested components,
+      otherwise fetches it with StoredKeyRequest and puts it to the cache.
+      Throws std::runtime_error if the key can't be fetched.
+     */
+    static Sailfish::Crypto::Key storedKey(
+        const Sailfish::Crypto::Key::Identifier& identifier,
+        const Sailfish::Crypto::Key::Components components);
+
+    static void insert(const Sailfish::Crypto::Key& key,
+                       const Sailfish::Crypto::Key::Components components);
+
+    static void invalidate(const Sailfish::Crypto::Key::Identifier& identifier);
+    static void invalidateCollection(const QString& collectionName,
+                                     const QString& storagePluginName);
+    static void clear();
+
+    static void setCapacity(const int capacity);
+    static void setTimeToLive(const qint64 timeToLive);
+};
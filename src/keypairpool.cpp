@@ -0,0 +1,206 @@
+#include "keypairpool.h"
+#include "generatekeyrequests.h"
+#include "metrics.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTimer>
+
+#include <memory>
+
+using namespace Sailfish::Crypto;
+
+KeyPairPool::KeyPairPool(const int depth, QObject* parent)
+    : QObject(parent)
+    , m_depth(qMax(depth, 0))
+{
+}
+
+Key KeyPairPool::takeKey(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::Operations operations,
+    const CryptoManager::DigestFunction digestFunction,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        QString poolKey;
+        Pool& pool = getPool(algorithm, operations, digestFunction, keyLength, pluginName, &poolKey);
+
+        const bool hit = not pool.keys.isEmpty();
+        if (hit) {
+            ++m_statistics.hits;
+        } else {
+            ++m_statistics.misses;
+        }
+
+        const Key key = hit ? pool.keys.dequeue() : Key();
+        scheduleRefill(pool, poolKey);
+
+        if (hit) {
+            return key;
+        }
+    }
+
+    return GenerateKeyRequests::createKey(algorithm, operations, digestFunction, keyLength, pluginName);
+}
+
+void KeyPairPool::prefill(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::Operations operations,
+    const CryptoManager::DigestFunction digestFunction,
+    const std::size_t keyLength,
+    const QString& pluginName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString poolKey;
+    Pool& pool = getPool(algorithm, operations, digestFunction, keyLength, pluginName, &poolKey);
+    scheduleRefill(pool, poolKey);
+}
+
+void KeyPairPool::setDepth(const int depth)
+{
+    QMutexLocker locker(&m_mutex);
+    m_depth = qMax(depth, 0);
+}
+
+KeyPairPool::Statistics KeyPairPool::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+KeyPairPool::Pool& KeyPairPool::getPool(
+    const CryptoManager::Algorithm algorithm,
+    const CryptoManager::Operations operations,
+    const CryptoManager::DigestFunction digestFunction,
+    const std::size_t keyLength,
+    const QString& pluginName,
+    QString* poolKey)
+{
+    *poolKey = QStringLiteral("%1/%2/%3/%4/%5")
+        .arg(static_cast<int>(algorithm))
+        .arg(static_cast<int>(operations))
+        .arg(static_cast<int>(digestFunction))
+        .arg(keyLength)
+        .arg(pluginName);
+
+    auto it = m_pools.find(*poolKey);
+    if (it == m_pools.end()) {
+        Pool pool;
+        pool.algorithm = algorithm;
+        pool.operations = operations;
+        pool.digestFunction = digestFunction;
+        pool.keyLength = keyLength;
+        pool.pluginName = pluginName;
+        it = m_pools.insert(*poolKey, pool);
+    }
+
+    return *it;
+}
+
+/*
+  Generation is always started through the event loop of the pool's thread,
+  so takeKey() may be called from any thread. Must be called with the mutex locked.
+ */
+void KeyPairPool::scheduleRefill(Pool& pool, const QString& poolKey)
+{
+    if (pool.generating or pool.keys.size() >= m_depth) {
+        return;
+    }
+
+    pool.generating = true;
+    QMetaObject::invokeMethod(this, "refill", Qt::QueuedConnection, Q_ARG(QString, poolKey));
+}
+
+/*
+  Generates one key and schedules the next one when it is finished, so at most one
+  key per pool is generated at a time. While request wrappers are busy the
+  generation is put off until they have been idle for IdleTime.
+ */
+void KeyPairPool::refill(const QString& poolKey)
+{
+    const qint64 idleTime = Metrics::idleTime();
+    if (idleTime < IdleTime) {
+        QTimer::singleShot(static_cast<int>(IdleTime - idleTime), this, [this, poolKey] () {
+            refill(poolKey);
+        });
+        return;
+    }
+
+    Pool parameters;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        Pool& pool = m_pools[poolKey];
+        if (pool.keys.size() >= m_depth) {
+            pool.generating = false;
+            return;
+        }
+
+        parameters.algorithm = pool.algorithm;
+        parameters.operations = pool.operations;
+        parameters.digestFunction = pool.digestFunction;
+        parameters.keyLength = pool.keyLength;
+        parameters.pluginName = pool.pluginName;
+    }
+
+    // The request is started without the lock, it may finish synchronously.
+    const QFuture<Key> future = GenerateKeyRequests::createKeyAsync(
+        parameters.algorithm,
+        parameters.operations,
+        parameters.digestFunction,
+        parameters.keyLength,
+        parameters.pluginName);
+
+    std::shared_ptr<QElapsedTimer> timer(new QElapsedTimer);
+    timer->start();
+
+    QFutureWatcher<Key>* const watcher = new QFutureWatcher<Key>(this);
+    connect(watcher, &QFutureWatcher<Key>::finished, this, [this, watcher, poolKey, timer] () {
+        const qint64 latency = timer->elapsed();
+
+        Key key;
+        bool succeeded = true;
+        try {
+            key = watcher->result();
+        } catch (const std::exception& e) {
+            qDebug() << "Error when generating pooled key:" << e.what();
+            succeeded = false;
+        }
+
+        watcher->deleteLater();
+
+        QMutexLocker locker(&m_mutex);
+        Pool& pool = m_pools[poolKey];
+
+        m_statistics.totalGenerationLatency += latency;
+        m_statistics.maxGenerationLatency = qMax(m_statistics.maxGenerationLatency, latency);
+
+        // The pool stays marked as generating until the retry, so takeKey() does not
+        // start another attempt before it.
+        if (not succeeded) {
+            ++m_statistics.errors;
+            const int retryDelay = pool.retryDelay;
+            pool.retryDelay = qMin(2 * pool.retryDelay, static_cast<int>(MaxRetryDelay));
+            QTimer::singleShot(retryDelay, this, [this, poolKey] () {
+                refill(poolKey);
+            });
+            return;
+        }
+
+        ++m_statistics.generated;
+        pool.generating = false;
+        pool.retryDelay = MinRetryDelay;
+        pool.keys.enqueue(key);
+        scheduleRefill(pool, poolKey);
+    });
+
+    watcher->setFuture(future);
+}
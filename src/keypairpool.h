@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+
+/*
+  Pool of pre-generated RSA and GOST key pairs.
+  There is a separate pool for every (algorithm, key size, operations, digest, plugin).
+  Key pair generation takes hundreds of milliseconds, so pools are filled in the
+  background one key at a time, and only when no request wrapper call has been in
+  flight for IdleTime milliseconds (see Metrics::idleTime()), to keep the daemon free
+  for foreground requests. A failed generation is retried after a delay which doubles
+  up to MaxRetryDelay.
+  takeKey() never waits for the refill: when the pool is empty it falls back to the
+  synchronous GenerateKeyRequests::createKey().
+  Keys are generated with GenerateKeyRequest and are not stored, stored keys are named
+  by the caller and can't be generated before the name is known.
+  The pool may be used from any thread, keys are generated in the thread the pool
+  belongs to, that thread must run an event loop.
+ */
+class KeyPairPool : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultDepth = 4;
+    static const int IdleTime = 200; // milliseconds
+    static const int MinRetryDelay = 1000; // milliseconds
+    static const int MaxRetryDelay = 60 * 1000; // milliseconds
+
+    struct Statistics {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 generated = 0;
+        quint64 errors = 0;
+        qint64 totalGenerationLatency = 0; // milliseconds
+        qint64 maxGenerationLatency = 0; // milliseconds
+    };
+
+    explicit KeyPairPool(const int depth = DefaultDepth, QObject* parent = nullptr);
+
+    Sailfish::Crypto::Key takeKey(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::Operations operations,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength,
+        const QString& pluginName);
+
+    /*
+      Starts filling the pool for given parameters without taking anything from it.
+     */
+    void prefill(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::Operations operations,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength,
+        const QString& pluginName);
+
+    void setDepth(const int depth);
+
+    Statistics statistics() const;
+
+private slots:
+    void refill(const QString& poolKey);
+
+private:
+    struct Pool {
+        Sailfish::Crypto::CryptoManager::Algorithm algorithm;
+        Sailfish::Crypto::CryptoManager::Operations operations;
+        Sailfish::Crypto::CryptoManager::DigestFunction digestFunction;
+        std::size_t keyLength;
+        QString pluginName;
+        QQueue<Sailfish::Crypto::Key> keys;
+        bool generating = false; // also while waiting for idle time or a retry
+        int retryDelay = MinRetryDelay;
+    };
+
+    Pool& getPool(
+        const Sailfish::Crypto::CryptoManager::Algorithm algorithm,
+        const Sailfish::Crypto::CryptoManager::Operations operations,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const std::size_t keyLength,
+        const QString& pluginName,
+        QString* poolKey);
+
+    void scheduleRefill(Pool& pool, const QString& poolKey);
+
+    mutable QMutex m_mutex;
+    QHash<QString, Pool> m_pools;
+    int m_depth;
+    Statistics m_statistics;
+};
@@ -0,0 +1,98 @@
+#include "localplugins.h"
+
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QPluginLoader>
+
+#include <atomic>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    struct State {
+        QMutex mutex;
+        std::atomic<bool> enabled{false};
+        bool loaded = false;
+        QString directory = LocalPlugins::DefaultPluginDirectory;
+        QHash<QString, CryptoPlugin*> plugins;
+    };
+
+    State& GetState()
+    {
+        static State state;
+        return state;
+    }
+
+    /*
+      Loads all crypto plugins from the directory, like the daemon does.
+      Must be called with the mutex locked.
+     */
+    void LoadPlugins(State& state)
+    {
+        state.loaded = true;
+
+        const QDir directory(state.directory);
+        for (const QString& fileName : directory.entryList(QDir::Files)) {
+            QPluginLoader loader(directory.absoluteFilePath(fileName));
+            CryptoPlugin* const plugin = qobject_cast<CryptoPlugin*>(loader.instance());
+            if (not plugin) {
+                loader.unload();
+                continue;
+            }
+
+            qDebug() << "Local crypto plugin loaded:" << plugin->name();
+            state.plugins.insert(plugin->name(), plugin);
+        }
+    }
+
+} // anonymous namespace
+
+const char* const LocalPlugins::DefaultPluginDirectory = "/usr/lib/Sailfish/Crypto/";
+
+void LocalPlugins::setEnabled(const bool enabled)
+{
+    GetState().enabled.store(enabled);
+}
+
+bool LocalPlugins::isEnabled()
+{
+    return GetState().enabled.load();
+}
+
+void LocalPlugins::setPluginDirectory(const QString& directory)
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+    state.directory = directory;
+    state.loaded = false;
+}
+
+CryptoPlugin* LocalPlugins::plugin(const QString& pluginName)
+{
+    State& state = GetState();
+    if (not state.enabled.load()) {
+        return nullptr;
+    }
+
+    QMutexLocker locker(&state.mutex);
+    if (not state.loaded) {
+        LoadPlugins(state);
+    }
+
+    return state.plugins.value(pluginName, nullptr);
+}
+
+CryptoPlugin* LocalPlugins::pluginForKey(const Key& key, const QString& pluginName)
+{
+    if (not key.name().isEmpty()) {
+        return nullptr;
+    }
+
+    return plugin(pluginName);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QObject>
+
+namespace Sailfish {
+    namespace Crypto {
+        class CryptoPlugin;
+    }
+}
+
+/*
+  Opt-in mode where crypto plugins (default OpenSSL or GOST) are loaded directly into
+  the client process instead of being called through the secrets daemon.
+  When it is enabled, the wrappers run operations which don't need stored keys
+  (digest, IV and non-stored key generation, operations with non-stored keys) in the
+  process, without serialization and IPC. Operations with stored keys always go to
+  the daemon, because only it has access to the key storage.
+ */
+class LocalPlugins : public QObject {
+    Q_OBJECT
+
+public:
+    static const char* const DefaultPluginDirectory;
+
+    static void setEnabled(const bool enabled);
+    static bool isEnabled();
+
+    static void setPluginDirectory(const QString& directory);
+
+    /*
+      Returns the loaded plugin with given name or nullptr if the mode is disabled or
+      the plugin can't be loaded.
+     */
+    static Sailfish::Crypto::CryptoPlugin* plugin(const QString& pluginName);
+
+    /*
+      The same as plugin() but returns nullptr for stored keys.
+     */
+    static Sailfish::Crypto::CryptoPlugin* pluginForKey(
+        const Sailfish::Crypto::Key& key,
+        const QString& pluginName);
+};
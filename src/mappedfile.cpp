@@ -0,0 +1,122 @@
+#include "mappedfile.h"
+
+#include <QtCore/QDebug>
+
+#include <cstring>
+
+MappedFile::MappedFile(const QString& fileName,
+                       const qint64 windowSize,
+                       QObject* parent)
+    : QIODevice(parent)
+    , m_file(fileName)
+    , m_windowSize(qMax<qint64>(windowSize, 4096))
+    , m_window(nullptr)
+    , m_windowOffset(0)
+    , m_windowLength(0)
+    , m_position(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(OpenMode mode)
+{
+    if (mode & WriteOnly) {
+        setErrorString(QStringLiteral("MappedFile is read-only"));
+        return false;
+    }
+
+    if (not m_file.open(QIODevice::ReadOnly)) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+
+    m_position = 0;
+
+    // Data is copied from the mapping directly, QIODevice buffer is not needed.
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void MappedFile::close()
+{
+    unmapWindow();
+    m_file.close();
+    QIODevice::close();
+}
+
+qint64 MappedFile::size() const
+{
+    return m_file.size();
+}
+
+bool MappedFile::seek(qint64 pos)
+{
+    if (pos < 0 or pos > size()) {
+        return false;
+    }
+
+    m_position = pos;
+    return QIODevice::seek(pos);
+}
+
+qint64 MappedFile::readData(char* data, qint64 maxSize)
+{
+    qint64 copied = 0;
+
+    while (copied < maxSize and m_position < size()) {
+        if (m_position < m_windowOffset or
+            m_position >= m_windowOffset + m_windowLength) {
+            if (not mapWindow(m_position)) {
+                return copied > 0 ? copied : -1;
+            }
+        }
+
+        const qint64 windowPosition = m_position - m_windowOffset;
+        const qint64 length = qMin(maxSize - copied, m_windowLength - windowPosition);
+        std::memcpy(data + copied, m_window + windowPosition, length);
+
+        copied += length;
+        m_position += length;
+    }
+
+    return copied;
+}
+
+qint64 MappedFile::writeData(const char*, qint64)
+{
+    return -1;
+}
+
+bool MappedFile::mapWindow(const qint64 position)
+{
+    unmapWindow();
+
+    // QFile::map() takes care of offsets which are not aligned to the page size.
+    const qint64 offset = position - position % m_windowSize;
+    const qint64 length = qMin(m_windowSize, size() - offset);
+
+    m_window = m_file.map(offset, length);
+    if (not m_window) {
+        qDebug() << "Error when mapping file:" << m_file.errorString();
+        setErrorString(m_file.errorString());
+        return false;
+    }
+
+    m_windowOffset = offset;
+    m_windowLength = length;
+    return true;
+}
+
+void MappedFile::unmapWindow()
+{
+    if (m_window) {
+        m_file.unmap(m_window);
+        m_window = nullptr;
+    }
+
+    m_windowOffset = 0;
+    m_windowLength = 0;
+}
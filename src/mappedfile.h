@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QtCore/QFile>
+#include <QtCore/QIODevice>
+
+/*
+  Read-only device over a memory-mapped file.
+  The file is mapped by windows of windowSize bytes which are remapped while
+  reading, so files of any size can be read without holding them in memory.
+  Every read copies data straight from the mapping.
+ */
+class MappedFile : public QIODevice {
+    Q_OBJECT
+
+public:
+    static const qint64 DefaultWindowSize = 64 * 1024 * 1024;
+
+    explicit MappedFile(const QString& fileName,
+                        const qint64 windowSize = DefaultWindowSize,
+                        QObject* parent = nullptr);
+    ~MappedFile();
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    qint64 size() const override;
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    bool mapWindow(const qint64 position);
+    void unmapWindow();
+
+    QFile m_file;
+    const qint64 m_windowSize;
+    uchar* m_window;
+    qint64 m_windowOffset;
+    qint64 m_windowLength;
+    qint64 m_position;
+};
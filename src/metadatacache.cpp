@@ -0,0 +1,421 @@
+#include "metadatacache.h"
+#include "utils.h"
+#include "connections.h"
+
+#include <Sailfish/Crypto/storedkeyidentifiersrequest.h>
+#include <Sailfish/Secrets/collectionnamesrequest.h>
+#include <Sailfish/Secrets/plugininforequest.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QEventLoop>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+
+#include <functional>
+
+using namespace Sailfish;
+
+namespace {
+
+    struct StorageMetadata {
+        bool collectionsLoaded = false;
+        QSet<QString> collections;
+        bool keysLoaded = false;
+        QHash<QString, Crypto::Key::Identifier> keys;
+    };
+
+    struct State {
+        QMutex mutex;
+        bool pluginsLoaded = false;
+        MetadataCache::PluginInfos plugins;
+        QSet<QString> pluginNames;
+        QHash<QString, StorageMetadata> storages;
+    };
+
+    State& GetState()
+    {
+        static State state;
+        return state;
+    }
+
+    QString CreateKeyId(const Crypto::Key::Identifier& identifier)
+    {
+        return identifier.name() + QLatin1Char('/') +
+            identifier.collectionName() + QLatin1Char('/') +
+            identifier.storagePluginName();
+    }
+
+    void SetupPluginInfoRequest(Secrets::PluginInfoRequest& request)
+    {
+        request.setManager(Connections::secretManager());
+    }
+
+    void SetupCollectionNamesRequest(Secrets::CollectionNamesRequest& request,
+                                     const QString& storagePluginName)
+    {
+        request.setManager(Connections::secretManager());
+        request.setStoragePluginName(storagePluginName);
+    }
+
+    void SetupStoredKeyIdentifiersRequest(Crypto::StoredKeyIdentifiersRequest& request,
+                                          const QString& storagePluginName)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setStoragePluginName(storagePluginName);
+    }
+
+    /*
+      Apply functions store fetched metadata, must be called with the mutex locked.
+     */
+    void ApplyPluginInfos(State& state, const Secrets::PluginInfoRequest& request)
+    {
+        state.plugins.storagePlugins = request.storagePlugins();
+        state.plugins.encryptionPlugins = request.encryptionPlugins();
+        state.plugins.encryptedStoragePlugins = request.encryptedStoragePlugins();
+        state.plugins.authenticationPlugins = request.authenticationPlugins();
+
+        state.pluginNames.clear();
+        for (const auto* plugins : { &state.plugins.storagePlugins,
+                                     &state.plugins.encryptionPlugins,
+                                     &state.plugins.encryptedStoragePlugins,
+                                     &state.plugins.authenticationPlugins }) {
+            for (const auto& plugin : *plugins) {
+                state.pluginNames.insert(plugin.name());
+            }
+        }
+
+        state.pluginsLoaded = true;
+    }
+
+    void ApplyCollectionNames(State& state,
+                              const QString& storagePluginName,
+                              const QStringList& collectionNames)
+    {
+        StorageMetadata& storage = state.storages[storagePluginName];
+        storage.collections = QSet<QString>::fromList(collectionNames);
+        storage.collectionsLoaded = true;
+    }
+
+    void ApplyKeyIdentifiers(State& state,
+                             const QString& storagePluginName,
+                             const QVector<Crypto::Key::Identifier>& identifiers)
+    {
+        StorageMetadata& storage = state.storages[storagePluginName];
+        storage.keys.clear();
+        for (const auto& identifier : identifiers) {
+            storage.keys.insert(CreateKeyId(identifier), identifier);
+        }
+        storage.keysLoaded = true;
+    }
+
+    void FetchPluginInfos(State& state)
+    {
+        Secrets::PluginInfoRequest request;
+        SetupPluginInfoRequest(request);
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            qDebug() << "Error when getting plugin info";
+            throw std::runtime_error("Error when getting plugin info");
+        }
+
+        QMutexLocker locker(&state.mutex);
+        ApplyPluginInfos(state, request);
+    }
+
+    void FetchCollectionNames(State& state, const QString& storagePluginName)
+    {
+        Secrets::CollectionNamesRequest request;
+        SetupCollectionNamesRequest(request, storagePluginName);
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            qDebug() << "Error when getting collection names";
+            throw std::runtime_error("Error when getting collection names");
+        }
+
+        QMutexLocker locker(&state.mutex);
+        ApplyCollectionNames(state, storagePluginName, request.collectionNames());
+    }
+
+    void FetchKeyIdentifiers(State& state, const QString& storagePluginName)
+    {
+        Crypto::StoredKeyIdentifiersRequest request;
+        SetupStoredKeyIdentifiersRequest(request, storagePluginName);
+        request.startRequest();
+        request.waitForFinished();
+
+        if (not IsRequestWasSuccessful(&request)) {
+            qDebug() << "Error when getting stored key identifiers";
+            throw std::runtime_error("Error when getting stored key identifiers");
+        }
+
+        QMutexLocker locker(&state.mutex);
+        ApplyKeyIdentifiers(state, storagePluginName, request.identifiers());
+    }
+
+    /*
+      Starts the heap allocated request and calls finished(request) when it is finished,
+      the request is deleted afterwards.
+     */
+    template <typename Request>
+    void StartWarmUpRequest(Request* const request,
+                            QEventLoop* loop,
+                            int* pending,
+                            std::function<void(Request&)> finished)
+    {
+        ++*pending;
+
+        QObject::connect(request, &Request::statusChanged, loop, [request, loop, pending, finished] () {
+            if (request->status() != Request::Finished) {
+                return;
+            }
+
+            finished(*request);
+            request->deleteLater();
+
+            if (--*pending == 0) {
+                loop->quit();
+            }
+        }, Qt::QueuedConnection);
+
+        request->startRequest();
+    }
+
+} // anonymous namespace
+
+bool MetadataCache::warmUp(const QStringList& storagePluginNames)
+{
+    qDebug() << Q_FUNC_INFO;
+
+    State& state = GetState();
+    QEventLoop loop;
+    int pending = 0;
+    bool succeeded = true;
+
+    Secrets::PluginInfoRequest* const pluginInfoRequest = new Secrets::PluginInfoRequest;
+    SetupPluginInfoRequest(*pluginInfoRequest);
+    StartWarmUpRequest<Secrets::PluginInfoRequest>(
+        pluginInfoRequest, &loop, &pending,
+        [&] (Secrets::PluginInfoRequest& request) {
+            if (not IsRequestWasSuccessful(&request)) {
+                succeeded = false;
+                return;
+            }
+
+            QMutexLocker locker(&state.mutex);
+            ApplyPluginInfos(state, request);
+        });
+
+    for (const QString& storagePluginName : storagePluginNames) {
+        Secrets::CollectionNamesRequest* const collectionsRequest =
+            new Secrets::CollectionNamesRequest;
+        SetupCollectionNamesRequest(*collectionsRequest, storagePluginName);
+        StartWarmUpRequest<Secrets::CollectionNamesRequest>(
+            collectionsRequest, &loop, &pending,
+            [&, storagePluginName] (Secrets::CollectionNamesRequest& request) {
+                if (not IsRequestWasSuccessful(&request)) {
+                    succeeded = false;
+                    return;
+                }
+
+                QMutexLocker locker(&state.mutex);
+                ApplyCollectionNames(state, storagePluginName, request.collectionNames());
+            });
+
+        Crypto::StoredKeyIdentifiersRequest* const keysRequest =
+            new Crypto::StoredKeyIdentifiersRequest;
+        SetupStoredKeyIdentifiersRequest(*keysRequest, storagePluginName);
+        StartWarmUpRequest<Crypto::StoredKeyIdentifiersRequest>(
+            keysRequest, &loop, &pending,
+            [&, storagePluginName] (Crypto::StoredKeyIdentifiersRequest& request) {
+                if (not IsRequestWasSuccessful(&request)) {
+                    succeeded = false;
+                    return;
+                }
+
+                QMutexLocker locker(&state.mutex);
+                ApplyKeyIdentifiers(state, storagePluginName, request.identifiers());
+            });
+    }
+
+    loop.exec();
+
+    return succeeded;
+}
+
+MetadataCache::PluginInfos MetadataCache::pluginInfos()
+{
+    State& state = GetState();
+
+    {
+        QMutexLocker locker(&state.mutex);
+        if (state.pluginsLoaded) {
+            return state.plugins;
+        }
+    }
+
+    FetchPluginInfos(state);
+
+    QMutexLocker locker(&state.mutex);
+    return state.plugins;
+}
+
+bool MetadataCache::isPluginExists(const QString& pluginName)
+{
+    State& state = GetState();
+
+    {
+        QMutexLocker locker(&state.mutex);
+        if (state.pluginsLoaded) {
+            return state.pluginNames.contains(pluginName);
+        }
+    }
+
+    FetchPluginInfos(state);
+
+    QMutexLocker locker(&state.mutex);
+    return state.pluginNames.contains(pluginName);
+}
+
+QStringList MetadataCache::collectionNames(const QString& storagePluginName)
+{
+    State& state = GetState();
+
+    {
+        QMutexLocker locker(&state.mutex);
+        const StorageMetadata& storage = state.storages[storagePluginName];
+        if (storage.collectionsLoaded) {
+            return storage.collections.toList();
+        }
+    }
+
+    FetchCollectionNames(state, storagePluginName);
+
+    QMutexLocker locker(&state.mutex);
+    return state.storages[storagePluginName].collections.toList();
+}
+
+bool MetadataCache::isCollectionExists(const QString& collectionName,
+                                       const QString& storagePluginName)
+{
+    State& state = GetState();
+
+    {
+        QMutexLocker locker(&state.mutex);
+        const StorageMetadata& storage = state.storages[storagePluginName];
+        if (storage.collectionsLoaded) {
+            return storage.collections.contains(collectionName);
+        }
+    }
+
+    FetchCollectionNames(state, storagePluginName);
+
+    QMutexLocker locker(&state.mutex);
+    return state.storages[storagePluginName].collections.contains(collectionName);
+}
+
+QVector<Crypto::Key::Identifier> MetadataCache::storedKeyIdentifiers(
+    const QString& storagePluginName)
+{
+    State& state = GetState();
+
+    {
+        QMutexLocker locker(&state.mutex);
+        const StorageMetadata& storage = state.storages[storagePluginName];
+        if (storage.keysLoaded) {
+            return storage.keys.values().toVector();
+        }
+    }
+
+    FetchKeyIdentifiers(state, storagePluginName);
+
+    QMutexLocker locker(&state.mutex);
+    return state.storages[storagePluginName].keys.values().toVector();
+}
+
+bool MetadataCache::isStoredKeyExists(const Crypto::Key::Identifier& identifier)
+{
+    State& state = GetState();
+    const QString keyId = CreateKeyId(identifier);
+
+    {
+        QMutexLocker locker(&state.mutex);
+        const StorageMetadata& storage = state.storages[identifier.storagePluginName()];
+        if (storage.keysLoaded) {
+            return storage.keys.contains(keyId);
+        }
+    }
+
+    FetchKeyIdentifiers(state, identifier.storagePluginName());
+
+    QMutexLocker locker(&state.mutex);
+    return state.storages[identifier.storagePluginName()].keys.contains(keyId);
+}
+
+void MetadataCache::collectionCreated(const QString& collectionName,
+                                      const QString& storagePluginName)
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+
+    StorageMetadata& storage = state.storages[storagePluginName];
+    if (storage.collectionsLoaded) {
+        storage.collections.insert(collectionName);
+    }
+}
+
+/*
+  Keys of the collection are deleted together with it.
+ */
+void MetadataCache::collectionDeleted(const QString& collectionName,
+                                      const QString& storagePluginName)
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+
+    StorageMetadata& storage = state.storages[storagePluginName];
+    storage.collections.remove(collectionName);
+
+    for (auto it = storage.keys.begin(); it != storage.keys.end();) {
+        if (it->collectionName() == collectionName) {
+            it = storage.keys.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void MetadataCache::storedKeyCreated(const Crypto::Key::Identifier& identifier)
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+
+    StorageMetadata& storage = state.storages[identifier.storagePluginName()];
+    if (storage.keysLoaded) {
+        storage.keys.insert(CreateKeyId(identifier), identifier);
+    }
+}
+
+void MetadataCache::storedKeyDeleted(const Crypto::Key::Identifier& identifier)
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+
+    state.storages[identifier.storagePluginName()].keys.remove(CreateKeyId(identifier));
+}
+
+void MetadataCache::clear()
+{
+    State& state = GetState();
+    QMutexLocker locker(&state.mutex);
+
+    state.pluginsLoaded = false;
+    state.plugins = PluginInfos();
+    state.pluginNames.clear();
+    state.storages.clear();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Sailfish/Crypto/key.h>
+#include <Sailfish/Secrets/plugininfo.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/*
+  In-process cache of the daemon metadata: installed plugins, collection names and
+  stored key identifiers of storage plugins.
+  Every kind of metadata is fetched once and kept in hash sets, so existence checks
+  do not scan lists. The request wrappers which create or delete collections and
+  stored keys update the cache, so it stays valid within the process.
+  warmUp() fetches all metadata with concurrent requests.
+ */
+class MetadataCache : public QObject {
+    Q_OBJECT
+
+public:
+    struct PluginInfos {
+        QVector<Sailfish::Secrets::PluginInfo> storagePlugins;
+        QVector<Sailfish::Secrets::PluginInfo> encryptionPlugins;
+        QVector<Sailfish::Secrets::PluginInfo> encryptedStoragePlugins;
+        QVector<Sailfish::Secrets::PluginInfo> authenticationPlugins;
+    };
+
+    /*
+      Fetches plugin infos and, for every storage plugin, collection names and stored
+      key identifiers. All requests are in flight together, returns when all of them
+      are finished. Returns false if any of them failed.
+     */
+    static bool warmUp(const QStringList& storagePluginNames);
+
+    /*
+      Metadata getters fetch missed metadata synchronously and throw std::runtime_error
+      if it can't be fetched.
+     */
+    static PluginInfos pluginInfos();
+    static bool isPluginExists(const QString& pluginName);
+
+    static QStringList collectionNames(const QString& storagePluginName);
+    static bool isCollectionExists(const QString& collectionName,
+                                   const QString& storagePluginName);
+
+    static QVector<Sailfish::Crypto::Key::Identifier> storedKeyIdentifiers(
+        const QString& storagePluginName);
+    static bool isStoredKeyExists(const Sailfish::Crypto::Key::Identifier& identifier);
+
+    static void collectionCreated(const QString& collectionName,
+                                  const QString& storagePluginName);
+    static void collectionDeleted(const QString& collectionName,
+                                  const QString& storagePluginName);
+    static void storedKeyCreated(const Sailfish::Crypto::Key::Identifier& identifier);
+    static void storedKeyDeleted(const Sailfish::Crypto::Key::Identifier& identifier);
+
+    static void clear();
+};
@@ -0,0 +1,264 @@
+#include "metrics.h"
+#include "utils.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QtAlgorithms>
+
+using namespace Sailfish::Crypto;
+
+std::atomic<bool> Metrics::s_enabled(false);
+std::atomic<int> Metrics::s_callsInFlight(0);
+std::atomic<qint64> Metrics::s_lastCallFinished(0);
+
+namespace {
+
+    struct Registry {
+        QMutex mutex;
+        QHash<QString, Metrics::Series> series;
+    };
+
+    Registry& GetRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    // Exported histogram boundaries, from about a microsecond to about a minute.
+    const int PROMETHEUS_MIN_POWER = 10; // 1.024 us
+    const int PROMETHEUS_MAX_POWER = 36; // 68.7 s
+
+    QByteArray EscapeLabel(const QString& value)
+    {
+        QByteArray result = value.toUtf8();
+        result.replace('\\', "\\\\");
+        result.replace('"', "\\\"");
+        result.replace('\n', "\\n");
+        return result;
+    }
+
+    QByteArray Labels(const Metrics::Series& series)
+    {
+        return
+            "operation=\"" + EscapeLabel(series.operation) +
+            "\",algorithm=\"" + EscapeLabel(series.algorithm) +
+            "\",plugin=\"" + EscapeLabel(series.plugin) +
+            "\",outcome=\"" + (series.succeeded ? "success" : "failure") + "\"";
+    }
+
+} // anonymous namespace
+
+quint64 Metrics::Series::percentile(const double percentile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(percentile / 100 * count + 0.5));
+    quint64 seen = 0;
+
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets.at(i);
+        if (seen >= rank) {
+            return (bucketLowerBound(i) + bucketUpperBound(i)) / 2;
+        }
+    }
+
+    return bucketUpperBound(buckets.size() - 1);
+}
+
+void Metrics::setEnabled(const bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Metrics::record(const char* operation,
+                     const char* algorithm,
+                     const QString& plugin,
+                     const bool succeeded,
+                     const qint64 latency,
+                     const qint64 bytesIn,
+                     const qint64 bytesOut)
+{
+    const QString key =
+        QLatin1String(operation) + QLatin1Char('/') +
+        QLatin1String(algorithm) + QLatin1Char('/') +
+        plugin + QLatin1Char('/') + QLatin1Char(succeeded ? '1' : '0');
+
+    Registry& registry = GetRegistry();
+    QMutexLocker locker(&registry.mutex);
+
+    auto it = registry.series.find(key);
+    if (it == registry.series.end()) {
+        Series series;
+        series.operation = QLatin1String(operation);
+        series.algorithm = QLatin1String(algorithm);
+        series.plugin = plugin;
+        series.succeeded = succeeded;
+        series.buckets.fill(0, BucketCount);
+        it = registry.series.insert(key, series);
+    }
+
+    const quint64 value = latency > 0 ? static_cast<quint64>(latency) : 0;
+    ++it->count;
+    it->bytesIn += qMax<qint64>(bytesIn, 0);
+    it->bytesOut += qMax<qint64>(bytesOut, 0);
+    it->latencySum += value;
+    ++it->buckets[bucketIndex(value)];
+}
+
+QVector<Metrics::Series> Metrics::snapshot()
+{
+    Registry& registry = GetRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return registry.series.values().toVector();
+}
+
+void Metrics::reset()
+{
+    Registry& registry = GetRegistry();
+    QMutexLocker locker(&registry.mutex);
+    registry.series.clear();
+}
+
+/*
+  Buckets are exported at powers of two only, 16 sub-buckets per power of two are
+  too many for Prometheus. Every series has the same fixed set of boundaries, so
+  rate() and histogram_quantile() see a stable set of le series between scrapes.
+ */
+QByteArray Metrics::prometheusText()
+{
+    const QVector<Series> allSeries = snapshot();
+    QByteArray result;
+
+    result += "# HELP cryptos_request_duration_seconds Latency of request wrapper calls.\n";
+    result += "# TYPE cryptos_request_duration_seconds histogram\n";
+    for (const auto& series : allSeries) {
+        const QByteArray labels = Labels(series);
+        quint64 cumulative = 0;
+        int i = 0;
+
+        for (int power = PROMETHEUS_MIN_POWER; power <= PROMETHEUS_MAX_POWER; ++power) {
+            const quint64 bound = Q_UINT64_C(1) << power;
+            while (i < series.buckets.size() and bucketUpperBound(i) <= bound) {
+                cumulative += series.buckets.at(i);
+                ++i;
+            }
+
+            result += "cryptos_request_duration_seconds_bucket{" + labels +
+                ",le=\"" + QByteArray::number(bound / 1e9, 'g', 6) + "\"} " +
+                QByteArray::number(cumulative) + "\n";
+        }
+
+        result += "cryptos_request_duration_seconds_bucket{" + labels + ",le=\"+Inf\"} " +
+            QByteArray::number(series.count) + "\n";
+        result += "cryptos_request_duration_seconds_sum{" + labels + "} " +
+            QByteArray::number(series.latencySum / 1e9, 'g', 9) + "\n";
+        result += "cryptos_request_duration_seconds_count{" + labels + "} " +
+            QByteArray::number(series.count) + "\n";
+    }
+
+    result += "# HELP cryptos_request_bytes_in_total Bytes passed to request wrappers.\n";
+    result += "# TYPE cryptos_request_bytes_in_total counter\n";
+    for (const auto& series : allSeries) {
+        result += "cryptos_request_bytes_in_total{" + Labels(series) + "} " +
+            QByteArray::number(series.bytesIn) + "\n";
+    }
+
+    result += "# HELP cryptos_request_bytes_out_total Bytes returned by request wrappers.\n";
+    result += "# TYPE cryptos_request_bytes_out_total counter\n";
+    for (const auto& series : allSeries) {
+        result += "cryptos_request_bytes_out_total{" + Labels(series) + "} " +
+            QByteArray::number(series.bytesOut) + "\n";
+    }
+
+    return result;
+}
+
+/*
+  Values below SubBucketCount have own buckets. A value in [2^m, 2^(m + 1)) goes to
+  one of SubBucketCount equal sub-buckets of that range.
+ */
+int Metrics::bucketIndex(const quint64 value)
+{
+    if (value < static_cast<quint64>(SubBucketCount)) {
+        return static_cast<int>(value);
+    }
+
+    const int msb = 63 - qCountLeadingZeroBits(value);
+    const int shift = msb - SubBucketBits;
+    const int subBucket = static_cast<int>(value >> shift) - SubBucketCount;
+    return SubBucketCount + shift * SubBucketCount + subBucket;
+}
+
+quint64 Metrics::bucketLowerBound(const int index)
+{
+    if (index < SubBucketCount) {
+        return index;
+    }
+
+    const int shift = (index - SubBucketCount) / SubBucketCount;
+    const int subBucket = (index - SubBucketCount) % SubBucketCount;
+    return static_cast<quint64>(SubBucketCount + subBucket) << shift;
+}
+
+quint64 Metrics::bucketUpperBound(const int index)
+{
+    if (index < SubBucketCount) {
+        return index + 1;
+    }
+
+    const int shift = (index - SubBucketCount) / SubBucketCount;
+    const int subBucket = (index - SubBucketCount) % SubBucketCount;
+    return static_cast<quint64>(SubBucketCount + subBucket + 1) << shift;
+}
+
+qint64 Metrics::idleTime()
+{
+    if (s_callsInFlight.load(std::memory_order_relaxed) > 0) {
+        return 0;
+    }
+    return MonotonicMilliseconds() - s_lastCallFinished.load(std::memory_order_relaxed);
+}
+
+void Metrics::callStarted()
+{
+    s_callsInFlight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::callFinished()
+{
+    s_lastCallFinished.store(MonotonicMilliseconds(), std::memory_order_relaxed);
+    s_callsInFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+const char* Metrics::algorithmName(const CryptoManager::Algorithm algorithm)
+{
+    switch (algorithm) {
+    case CryptoManager::AlgorithmAes:
+        return "aes";
+    case CryptoManager::AlgorithmRsa:
+        return "rsa";
+    case CryptoManager::AlgorithmGost:
+        return "gost";
+    default:
+        return "other";
+    }
+}
+
+const char* Metrics::digestName(const CryptoManager::DigestFunction digestFunction)
+{
+    switch (digestFunction) {
+    case CryptoManager::DigestSha1:
+        return "sha1";
+    case CryptoManager::DigestSha256:
+        return "sha256";
+    case CryptoManager::DigestSha512:
+        return "sha512";
+    case CryptoManager::DigestGost_2012_256:
+        return "gost2012_256";
+    default:
+        return "other";
+    }
+}
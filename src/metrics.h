@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+
+#include <atomic>
+
+/*
+  Per-operation metrics of the request wrappers: latency histogram, bytes in and out,
+  plugin, algorithm and outcome of every call.
+  Disabled by default, a disabled call costs one relaxed atomic load and the two
+  relaxed atomic updates of the activity tracking, which is always on.
+  Latency is stored in a log-linear (HDR-style) histogram with 16 sub-buckets per
+  power of two nanoseconds, so the relative error of percentiles is below 6.25%.
+ */
+class Metrics : public QObject {
+    Q_OBJECT
+
+public:
+    static const int SubBucketBits = 4;
+    static const int SubBucketCount = 1 << SubBucketBits;
+    static const int BucketCount = SubBucketCount + (64 - SubBucketBits) * SubBucketCount;
+
+    struct Series {
+        QString operation;
+        QString algorithm;
+        QString plugin;
+        bool succeeded = false;
+        quint64 count = 0;
+        quint64 bytesIn = 0;
+        quint64 bytesOut = 0;
+        quint64 latencySum = 0; // nanoseconds
+        QVector<quint64> buckets;
+
+        /*
+          Latency in nanoseconds for percentile from 0 to 100.
+         */
+        quint64 percentile(const double percentile) const;
+    };
+
+    static void setEnabled(const bool enabled);
+
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void record(const char* operation,
+                       const char* algorithm,
+                       const QString& plugin,
+                       const bool succeeded,
+                       const qint64 latency,
+                       const qint64 bytesIn,
+                       const qint64 bytesOut);
+
+    static QVector<Series> snapshot();
+    static void reset();
+
+    /*
+      All series in Prometheus text exposition format.
+     */
+    static QByteArray prometheusText();
+
+    static int bucketIndex(const quint64 value);
+    static quint64 bucketLowerBound(const int index);
+    static quint64 bucketUpperBound(const int index);
+
+    static const char* algorithmName(const Sailfish::Crypto::CryptoManager::Algorithm algorithm);
+    static const char* digestName(const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    /*
+      Milliseconds since the last wrapper call was finished, 0 while any call is in
+      flight. Background work (e.g. KeyPairPool) uses it to run in idle time only.
+     */
+    static qint64 idleTime();
+
+    static void callStarted();
+    static void callFinished();
+
+private:
+    static std::atomic<bool> s_enabled;
+    static std::atomic<int> s_callsInFlight;
+    static std::atomic<qint64> s_lastCallFinished; // MonotonicMilliseconds()
+};
+
+/*
+  Measures one wrapper call and records it when the scope is left.
+  The call is recorded as failed unless setSucceeded() was called, so thrown
+  exceptions are counted too.
+ */
+class MetricsScope {
+public:
+    MetricsScope(const char* operation,
+                 const char* algorithm,
+                 const QString& plugin,
+                 const qint64 bytesIn = 0)
+        : m_enabled(Metrics::isEnabled())
+        , m_operation(operation)
+        , m_algorithm(algorithm)
+        , m_plugin(m_enabled ? plugin : QString())
+        , m_bytesIn(bytesIn)
+        , m_bytesOut(0)
+        , m_succeeded(false)
+    {
+        Metrics::callStarted();
+        if (m_enabled) {
+            m_timer.start();
+        }
+    }
+
+    ~MetricsScope()
+    {
+        Metrics::callFinished();
+        if (m_enabled) {
+            Metrics::record(m_operation, m_algorithm, m_plugin, m_succeeded,
+                            m_timer.nsecsElapsed(), m_bytesIn, m_bytesOut);
+        }
+    }
+
+    void setSucceeded(const qint64 bytesOut = 0)
+    {
+        m_succeeded = true;
+        m_bytesOut = bytesOut;
+    }
+
+    void addBytesIn(const qint64 bytesIn)
+    {
+        m_bytesIn += bytesIn;
+    }
+
+private:
+    const bool m_enabled;
+    const char* const m_operation;
+    const char* const m_algorithm;
+    const QString m_plugin;
+    qint64 m_bytesIn;
+    qint64 m_bytesOut;
+    bool m_succeeded;
+    QElapsedTimer m_timer;
+};
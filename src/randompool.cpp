@@ -0,0 +1,195 @@
+#include "randompool.h"
+#include "utils.h"
+#include "connections.h"
+#include "securearena.h"
+
+#include <Sailfish/Crypto/generaterandomdatarequest.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+
+#include <cstring>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    QByteArray FetchRandomData(const QString& pluginName,
+                               const QString& csprngEngineName,
+                               const int count)
+    {
+        GenerateRandomDataRequest request;
+        request.setManager(Connections::cryptoManager());
+        request.setCryptoPluginName(pluginName);
+        request.setCsprngEngineName(csprngEngineName);
+        request.setNumberBytes(count);
+        request.startRequest();
+        request.waitForFinished();
+
+        // A short answer would make the callers loop forever waiting for the rest.
+        const QByteArray data = request.generatedData();
+        if (not IsRequestWasSuccessful(&request) or data.size() != count) {
+            qDebug() << "Error when generating random data";
+            throw std::runtime_error("Error when generating random data");
+        }
+
+        return data;
+    }
+
+    QThreadStorage<RandomPool*> threadPools;
+
+} // anonymous namespace
+
+RandomPool* RandomPool::threadPool()
+{
+    if (not threadPools.hasLocalData()) {
+        threadPools.setLocalData(new RandomPool(CryptoManager::DefaultCryptoPluginName,
+                                                GenerateRandomDataRequest::DefaultCsprngEngineName));
+    }
+    return threadPools.localData();
+}
+
+void RandomPool::releaseThreadPool()
+{
+    if (threadPools.hasLocalData()) {
+        threadPools.setLocalData(nullptr);
+    }
+}
+
+RandomPool::RandomPool(const QString& pluginName,
+                       const QString& csprngEngineName,
+                       const int batchSize,
+                       const int lowWatermark,
+                       QObject* parent)
+    : QObject(parent)
+    , m_pluginName(pluginName)
+    , m_csprngEngineName(csprngEngineName)
+    , m_batchSize(qMax(batchSize, 1))
+    , m_lowWatermark(qMin(lowWatermark, m_batchSize))
+    , m_head(0)
+    , m_available(0)
+    , m_refillInFlight(false)
+{
+    m_buffer.resize(2 * m_batchSize);
+}
+
+QByteArray RandomPool::takeBytes(const int count)
+{
+    if (count <= 0) {
+        return {};
+    }
+
+    // The ring size never changes, so it is read without the lock.
+    if (count > m_buffer.size()) {
+        return FetchRandomData(m_pluginName, m_csprngEngineName, count);
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    while (m_available < count) {
+        locker.unlock();
+        const QByteArray data = FetchRandomData(m_pluginName, m_csprngEngineName, m_batchSize);
+        locker.relock();
+        if (store(data) == 0) {
+            throw std::runtime_error("Error when generating random data");
+        }
+    }
+
+    QByteArray result(count, Qt::Uninitialized);
+    load(result.data(), count);
+
+    if (m_available < m_lowWatermark) {
+        scheduleRefill();
+    }
+
+    return result;
+}
+
+int RandomPool::available() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_available;
+}
+
+/*
+  Copies new random data to the free part of the ring, the rest is dropped.
+  The data is shared with the request it came from, its storage is wiped in place,
+  so no copy of it is left. Returns the number of bytes stored.
+  Must be called with the mutex locked.
+ */
+int RandomPool::store(const QByteArray& data)
+{
+    const int capacity = m_buffer.size();
+    const int count = qMin(data.size(), capacity - m_available);
+    const int tail = (m_head + m_available) % capacity;
+    const int first = qMin(count, capacity - tail);
+
+    std::memcpy(m_buffer.data() + tail, data.constData(), first);
+    std::memcpy(m_buffer.data(), data.constData() + first, count - first);
+    m_available += count;
+
+    SecureWipe(const_cast<char*>(data.constData()), data.size());
+    return count;
+}
+
+/*
+  Copies count bytes from the head of the ring and wipes them.
+  Must be called with the mutex locked.
+ */
+void RandomPool::load(char* data, const int count)
+{
+    const int capacity = m_buffer.size();
+    const int first = qMin(count, capacity - m_head);
+
+    std::memcpy(data, m_buffer.data() + m_head, first);
+    SecureWipe(m_buffer.data() + m_head, first);
+    std::memcpy(data + first, m_buffer.data(), count - first);
+    SecureWipe(m_buffer.data(), count - first);
+
+    m_head = (m_head + count) % capacity;
+    m_available -= count;
+}
+
+/*
+  Must be called with the mutex locked.
+ */
+void RandomPool::scheduleRefill()
+{
+    if (m_refillInFlight) {
+        return;
+    }
+
+    m_refillInFlight = true;
+    QMetaObject::invokeMethod(this, "refill", Qt::QueuedConnection);
+}
+
+void RandomPool::refill()
+{
+    GenerateRandomDataRequest* const request = new GenerateRandomDataRequest;
+    request->setManager(Connections::cryptoManager());
+    request->setCryptoPluginName(m_pluginName);
+    request->setCsprngEngineName(m_csprngEngineName);
+    request->setNumberBytes(m_batchSize);
+
+    connect(request, &GenerateRandomDataRequest::statusChanged, this, [this, request] () {
+        if (request->status() != Request::Finished) {
+            return;
+        }
+
+        QByteArray data;
+        if (IsRequestWasSuccessful(request)) {
+            data = request->generatedData();
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_refillInFlight = false;
+        if (not data.isEmpty()) {
+            store(data);
+        }
+
+        request->deleteLater();
+    });
+
+    request->startRequest();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "securearena.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+
+/*
+  Reservoir of random bytes which are fetched from the CSPRNG engine of the crypto
+  plugin by large GenerateRandomDataRequest batches.
+  Small pieces (nonces, salts, tokens) are served from the reservoir, which is a ring
+  of twice the batch size in SecureArena memory. Bytes never move inside it and are
+  wiped when consumed, the fetched batches are wiped after they are stored. Pieces
+  larger than the ring are fetched directly. When the reservoir falls below the low
+  watermark, the next batch is requested asynchronously in the thread the pool
+  belongs to, that thread must run an event loop. If the reservoir is dry, the batch
+  is fetched synchronously.
+  The pool may be used from any thread.
+ */
+class RandomPool : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultBatchSize = 16 * 1024;
+    static const int DefaultLowWatermark = 4 * 1024;
+
+    explicit RandomPool(const QString& pluginName,
+                        const QString& csprngEngineName,
+                        const int batchSize = DefaultBatchSize,
+                        const int lowWatermark = DefaultLowWatermark,
+                        QObject* parent = nullptr);
+
+    /*
+      Pool of the default crypto plugin and CSPRNG engine for the calling thread.
+      It is created on the first use, belongs to that thread and is destroyed when the
+      thread finishes. The main thread must call releaseThreadPool() before the
+      application object is destroyed.
+     */
+    static RandomPool* threadPool();
+    static void releaseThreadPool();
+
+    /*
+      Returns count random bytes. Throws std::runtime_error if the random data
+      can't be generated.
+     */
+    QByteArray takeBytes(const int count);
+
+    int available() const;
+
+private slots:
+    void refill();
+
+private:
+    int store(const QByteArray& data);
+    void load(char* data, const int count);
+    void scheduleRefill();
+
+    const QString m_pluginName;
+    const QString m_csprngEngineName;
+    const int m_batchSize;
+    const int m_lowWatermark;
+
+    mutable QMutex m_mutex;
+    SecureBuffer m_buffer;
+    int m_head;
+    int m_available;
+    bool m_refillInFlight;
+};
@@ -1,5 +1,8 @@
 #include "requests.h"
 #include "utils.h"
+#include "connections.h"
+#include "keycache.h"
+#include "metadatacache.h"
 
 #include <Sailfish/Crypto/cipherrequest.h>
 #include <Sailfish/Crypto/cryptomanager.h>
@@ -8,9 +11,7 @@
 #include <Sailfish/Crypto/generaterandomdatarequest.h>
 #include <Sailfish/Crypto/generatestoredkeyrequest.h>
 #include <Sailfish/Crypto/seedrandomdatageneratorrequest.h>
-#include <Sailfish/Crypto/storedkeyrequest.h>
 
-#include <Sailfish/Secrets/collectionnamesrequest.h>
 #include <Sailfish/Secrets/createcollectionrequest.h>
 #include <Sailfish/Secrets/deletecollectionrequest.h>
 #include <Sailfish/Secrets/plugininforequest.h>
@@ -28,17 +29,6 @@ namespace {
     const QString DB_NAME = QStringLiteral("org.sailfishos.secrets.plugin.storage.sqlite");
     const Key::Identifier keyIdentifier(KEY_NAME, COLLECTION_NAME, DB_NAME);
 
-    bool IsCollectionExists(const QStringList& collectionNames,
-                            const QString& name)
-    {
-        for (const auto& collectionName : collectionNames) {
-            if (collectionName == name) {
-                return true;
-            }
-        }
-        return false;
-    }
-
 } // anonymous namespace
 
 /*
@@ -52,9 +42,8 @@ void Requests::getRandomData()
 
     const std::size_t RANDOM_DATA_LENGTH = 128;
 
-    CryptoManager manager;
     GenerateRandomDataRequest* const request = new GenerateRandomDataRequest;
-    request->setManager(&manager);
+    request->setManager(Connections::cryptoManager());
     request->setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
     request->setCsprngEngineName(GenerateRandomDataRequest::DefaultCsprngEngineName);
     request->setNumberBytes(RANDOM_DATA_LENGTH);
@@ -72,9 +61,8 @@ void Requests::seedRandomGenerator()
 {
     qDebug() << Q_FUNC_INFO;
 
-    CryptoManager manager;
     SeedRandomDataGeneratorRequest* const request = new SeedRandomDataGeneratorRequest;
-    request->setManager(&manager);
+    request->setManager(Connections::cryptoManager());
     request->setCryptoPluginName(CryptoManager::DefaultCryptoPluginName);
     request->setCsprngEngineName(GenerateRandomDataRequest::DefaultCsprngEngineName);
     request->setEntropyEstimate(0.1);
@@ -89,49 +77,49 @@ void Requests::seedRandomGenerator()
     });
 }
 
+/*
+  Collection names are taken from MetadataCache, they are fetched once per process.
+ */
 bool Requests::isCollectionExists()
 {
     qDebug() << Q_FUNC_INFO;
 
-    SecretManager manager;
-    CollectionNamesRequest* const request = new CollectionNamesRequest;
-    request->setManager(&manager);
-    request->setStoragePluginName(DB_NAME);
-    request->startRequest();
-    request->waitForFinished();
-    request->deleteLater();
-
-    if (IsRequestWasSuccessful(request)) {
-        const auto collectionNames = request->collectionNames();
-        return IsCollectionExists(collectionNames, COLLECTION_NAME);
+    try {
+        return MetadataCache::isCollectionExists(COLLECTION_NAME, DB_NAME);
+    } catch (const std::exception& e) {
+        qDebug() << e.what();
+        return false;
     }
-
-    return false;
 }
 
 bool Requests::deleteCollection()
 {
     qDebug() << Q_FUNC_INFO;
 
-    SecretManager manager;
     DeleteCollectionRequest* const request = new DeleteCollectionRequest;
-    request->setManager(&manager);
+    request->setManager(Connections::secretManager());
     request->setStoragePluginName(DB_NAME);
     request->setCollectionName(COLLECTION_NAME);
     request->startRequest();
     request->waitForFinished();
     request->deleteLater();
 
-    return IsRequestWasSuccessful(request);
+    KeyCache::invalidateCollection(COLLECTION_NAME, DB_NAME);
+
+    if (not IsRequestWasSuccessful(request)) {
+        return false;
+    }
+
+    MetadataCache::collectionDeleted(COLLECTION_NAME, DB_NAME);
+    return true;
 }
 
 bool Requests::createCollection()
 {
     qDebug() << Q_FUNC_INFO;
 
-    SecretManager manager;
     CreateCollectionRequest* const request = new CreateCollectionRequest;
-    request->setManager(&manager);
+    request->setManager(Connections::secretManager());
     request->setEncryptionPluginName("org.sailfishos.secrets.plugin.encryption.openssl");
     request->setStoragePluginName(DB_NAME);
     request->setCollectionName(COLLECTION_NAME);
@@ -139,39 +127,29 @@ bool Requests::createCollection()
     request->waitForFinished();
     request->deleteLater();
 
-    return IsRequestWasSuccessful(request);
+    if (not IsRequestWasSuccessful(request)) {
+        return false;
+    }
+
+    MetadataCache::collectionCreated(COLLECTION_NAME, DB_NAME);
+    return true;
 }
 
-Sailfish::Crypto::Key Requests::getStoredKey()
+/*
+  Stored key is taken from KeyCache, the daemon is asked only when the cache has
+  no fresh entry with all requested components.
+ */
+Sailfish::Crypto::Key Requests::getStoredKey(const Key::Components components)
 {
     qDebug() << Q_FUNC_INFO;
 
-    CryptoManager manager;
-    StoredKeyRequest request;
-    request.setManager(&manager);
-    request.setIdentifier(keyIdentifier);
-    request.setKeyComponents(Key::MetaData | Key::PublicKeyData | Key::PrivateKeyData | Key::SecretKeyData);
-    request.startRequest();
-    request.waitForFinished();
-
-    if (not IsRequestWasSuccessful(&request)) {
-        qDebug() << "Error when getStoredKey";
-        throw std::runtime_error("Error when getStoredKey");
-    }
-
-    return request.storedKey();
+    return KeyCache::storedKey(keyIdentifier, components);
 }
 
 void Requests::pluginInfo()
 {
     qDebug() << Q_FUNC_INFO;
 
-    SecretManager manager;
-    PluginInfoRequest request;
-    request.setManager(&manager);
-    request.startRequest();
-    request.waitForFinished();
-
     const auto PrintPluginInfo = [] (const QString& pluginType,
                                      const QVector<PluginInfo>& pluginInfos) {
         for (const auto& pluginInfo : pluginInfos) {
@@ -179,27 +157,47 @@ void Requests::pluginInfo()
         }
     };
 
-    if (IsRequestWasSuccessful(&request)) {
-        PrintPluginInfo("storage plugin: ", request.storagePlugins());
-        PrintPluginInfo("encryption plugin: ", request.encryptionPlugins());
-        PrintPluginInfo("encrypted storage plugin: ", request.encryptedStoragePlugins());
-        PrintPluginInfo("authentication plugin: ", request.authenticationPlugins());
+    try {
+        const MetadataCache::PluginInfos pluginInfos = MetadataCache::pluginInfos();
+        PrintPluginInfo("storage plugin: ", pluginInfos.storagePlugins);
+        PrintPluginInfo("encryption plugin: ", pluginInfos.encryptionPlugins);
+        PrintPluginInfo("encrypted storage plugin: ", pluginInfos.encryptedStoragePlugins);
+        PrintPluginInfo("authentication plugin: ", pluginInfos.authenticationPlugins);
+    } catch (const std::exception& e) {
+        qDebug() << e.what();
     }
 }
 
+/*
+  Plugin infos, collection names and stored key identifiers are fetched together,
+  so the following requests do not wait for them one by one.
+ */
+bool Requests::warmUp()
+{
+    qDebug() << Q_FUNC_INFO;
+
+    return MetadataCache::warmUp(QStringList() << DB_NAME);
+}
+
 bool Requests::deleteStoredKey(const QString& keyName,
                                const QString& collectionName,
                                const QString& dbName)
 {
     qDebug() << Q_FUNC_INFO;
 
-    CryptoManager manager;
     DeleteStoredKeyRequest* const request = new DeleteStoredKeyRequest;
     request->setIdentifier(Key::Identifier(keyName, collectionName, dbName));
-    request->setManager(&manager);
+    request->setManager(Connections::cryptoManager());
     request->startRequest();
     request->waitForFinished();
     request->deleteLater();
 
-    return IsRequestWasSuccessful(request);
+    KeyCache::invalidate(Key::Identifier(keyName, collectionName, dbName));
+
+    if (not IsRequestWasSuccessful(request)) {
+        return false;
+    }
+
+    MetadataCache::storedKeyDeleted(Key::Identifier(keyName, collectionName, dbName));
+    return true;
 }
@@ -17,8 +17,12 @@ public:
     static bool isCollectionExists();
     static bool deleteCollection();
     static bool createCollection();
-    static Sailfish::Crypto::Key getStoredKey();
+    static Sailfish::Crypto::Key getStoredKey(
+        const Sailfish::Crypto::Key::Components components =
+            Sailfish::Crypto::Key::MetaData |
+            Sailfish::Crypto::Key::PublicKeyData);
     static void pluginInfo();
+    static bool warmUp();
     static bool deleteStoredKey(const QString& keyName,
                                 const QString& collectionName,
                                 const QString& dbName);
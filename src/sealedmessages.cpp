@@ -0,0 +1,512 @@
+#include "sealedmessages.h"
+#include "byteview.h"
+#include "envelopeformat.h"
+#include "utils.h"
+#include "connections.h"
+#include "encryptdecryptrequests.h"
+#include "signverifyrequests.h"
+#include "createivrequests.h"
+#include "trace.h"
+
+#include <Sailfish/Crypto/verifyrequest.h>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QEventLoop>
+#include <QtCore/QIODevice>
+#include <QtCore/QtEndian>
+
+#include <climits>
+#include <memory>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    const char ENVELOPE_MAGIC[] = "CSE1";
+    const int ENVELOPE_MAGIC_SIZE = 4;
+    const quint8 ENVELOPE_VERSION = 1;
+    const int GCM_TAG_SIZE = 16;
+    // Magic, version, chunk size, chunk count and IV size.
+    const int HEADER_FIELDS_SIZE = ENVELOPE_MAGIC_SIZE + 1 + 4 + 4 + 1;
+    // Data size (4), tag size (1) and tag of an empty chunk.
+    const int MIN_CHUNK_RECORD_SIZE = 4 + 1 + GCM_TAG_SIZE;
+
+    QByteArray CreateMessageIV(const Key& encryptionKey, const QString& encryptionPluginName)
+    {
+        const QByteArray iv = CreateIVRequests::createIV(
+            CryptoManager::AlgorithmAes, CryptoManager::BlockModeGcm,
+            encryptionKey.size(), encryptionPluginName);
+        if (iv.size() < 4 or iv.size() > 255) {
+            throw std::runtime_error("Error when sealing message: bad IV");
+        }
+        return iv;
+    }
+
+    QByteArray CreateHeader(const QByteArray& iv, const int chunkSize, const int chunkCount)
+    {
+        QByteArray header;
+        header.append(ENVELOPE_MAGIC, ENVELOPE_MAGIC_SIZE);
+        AppendUInt8(&header, ENVELOPE_VERSION);
+        AppendUInt32(&header, static_cast<quint32>(chunkSize));
+        AppendUInt32(&header, static_cast<quint32>(chunkCount));
+        AppendUInt8(&header, static_cast<quint8>(iv.size()));
+        header.append(iv);
+        return header;
+    }
+
+    QByteArray CreateChunkIV(const QByteArray& iv, const int index)
+    {
+        QByteArray result = iv;
+        uchar counter[4];
+        qToBigEndian(static_cast<quint32>(index), counter);
+        for (int i = 0; i < 4; ++i) {
+            result[result.size() - 4 + i] = result.at(result.size() - 4 + i) ^ counter[i];
+        }
+        return result;
+    }
+
+    QByteArray CreateChunkAuthData(const QByteArray& header, const int index, const bool last)
+    {
+        QByteArray result = header;
+        AppendUInt32(&result, static_cast<quint32>(index));
+        AppendUInt8(&result, last ? 1 : 0);
+        return result;
+    }
+
+    /*
+      bodySize is the size of the envelope after the header.
+     */
+    bool IsValidHeader(const ByteView& magic, const quint8 version, const quint32 chunkSize,
+                       const quint32 chunkCount, const int ivSize, const qint64 bodySize)
+    {
+        return qstrncmp(magic.data(), ENVELOPE_MAGIC, ENVELOPE_MAGIC_SIZE) == 0 and
+               version == ENVELOPE_VERSION and
+               chunkSize > 0 and chunkSize <= INT_MAX and
+               chunkCount > 0 and chunkCount <= INT_MAX and
+               chunkCount <= bodySize / MIN_CHUNK_RECORD_SIZE and
+               ivSize >= 4;
+    }
+
+    void AppendChunkRecord(QByteArray* envelope, const EncryptDecryptRequests::BatchResult& result)
+    {
+        if (not result.succeeded or result.authTag.size() != GCM_TAG_SIZE) {
+            qDebug() << "Error when sealing message:" << result.errorMessage;
+            throw std::runtime_error("Error when encrypt");
+        }
+
+        AppendUInt32(envelope, static_cast<quint32>(result.data.size()));
+        envelope->append(result.data);
+        AppendUInt8(envelope, static_cast<quint8>(result.authTag.size()));
+        envelope->append(result.authTag);
+    }
+
+    /*
+      Returns the signature size and the signature, which end the envelope.
+     */
+    QByteArray SignEnvelope(
+        const Key& signingKey,
+        const QByteArray& digest,
+        const QString& signingPluginName,
+        const CryptoManager::SignaturePadding signaturePadding,
+        const CryptoManager::DigestFunction digestFunction)
+    {
+        const QByteArray signature = SignVerifyRequests::sign(
+            signingKey, digest, signingPluginName, signaturePadding, digestFunction);
+        if (signature.isEmpty() or signature.size() > 0xffff) {
+            throw std::runtime_error("Error when signing message");
+        }
+
+        QByteArray result;
+        AppendUInt16(&result, static_cast<quint16>(signature.size()));
+        result.append(signature);
+        return result;
+    }
+
+    QByteArray EnvelopeDigest(const ByteView& body)
+    {
+        return QCryptographicHash::hash(body.toRawByteArray(), QCryptographicHash::Sha256);
+    }
+
+    QByteArray ReadEnvelope(QIODevice* input, const qint64 size)
+    {
+        const QByteArray data = input->read(size);
+        if (data.size() != size) {
+            throw std::runtime_error("Bad envelope");
+        }
+        return data;
+    }
+
+    void WriteOutput(QIODevice* output, const QByteArray& data)
+    {
+        if (output->write(data) != data.size()) {
+            throw std::runtime_error("Error when writing output");
+        }
+    }
+
+    struct StreamHeader {
+        QByteArray header;
+        QByteArray iv;
+        int chunkSize;
+        int chunkCount;
+    };
+
+    StreamHeader ReadHeader(QIODevice* input)
+    {
+        StreamHeader result;
+        result.header = ReadEnvelope(input, HEADER_FIELDS_SIZE);
+
+        const ByteView fields(result.header);
+        EnvelopeReader reader(fields);
+        const ByteView magic = reader.bytes(ENVELOPE_MAGIC_SIZE);
+        const quint8 version = reader.uint8();
+        const quint32 chunkSize = reader.uint32();
+        const quint32 chunkCount = reader.uint32();
+        const quint8 ivSize = reader.uint8();
+        result.iv = ReadEnvelope(input, ivSize);
+
+        if (not IsValidHeader(magic, version, chunkSize, chunkCount, ivSize,
+                              input->size() - input->pos())) {
+            throw std::runtime_error("Bad envelope header");
+        }
+
+        result.header.append(result.iv);
+        result.chunkSize = static_cast<int>(chunkSize);
+        result.chunkCount = static_cast<int>(chunkCount);
+        return result;
+    }
+
+    /*
+      Reads the next chunk record, it is added to the digest if one is given.
+     */
+    EncryptDecryptRequests::BatchItem ReadChunkRecord(
+        QIODevice* input, const int chunkSize, QCryptographicHash* digest)
+    {
+        const QByteArray dataSize = ReadEnvelope(input, 4);
+        const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(dataSize.constData()));
+        if (size > static_cast<quint32>(chunkSize)) {
+            throw std::runtime_error("Bad envelope");
+        }
+
+        EncryptDecryptRequests::BatchItem item;
+        item.data = ReadEnvelope(input, size);
+        const QByteArray tagSize = ReadEnvelope(input, 1);
+        if (static_cast<quint8>(tagSize.at(0)) != GCM_TAG_SIZE) {
+            throw std::runtime_error("Bad envelope");
+        }
+        item.authTag = ReadEnvelope(input, GCM_TAG_SIZE);
+
+        if (digest) {
+            digest->addData(dataSize);
+            digest->addData(item.data);
+            digest->addData(tagSize);
+            digest->addData(item.authTag);
+        }
+
+        return item;
+    }
+
+} // anonymous namespace
+
+QByteArray SealedMessages::seal(
+    const Key& encryptionKey,
+    const Key& signingKey,
+    const ByteView& plainText,
+    const QString& encryptionPluginName,
+    const QString& signingPluginName,
+    const CryptoManager::SignaturePadding signaturePadding,
+    const CryptoManager::DigestFunction digestFunction,
+    const int chunkSize,
+    const int windowSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    if (chunkSize <= 0) {
+        throw std::runtime_error("Error when sealing message: bad chunk size");
+    }
+
+    trace.phase("setup");
+    const QByteArray iv = CreateMessageIV(encryptionKey, encryptionPluginName);
+
+    // Empty message is one empty chunk, so there is always the last chunk.
+    const int chunkCount = qMax(1, (plainText.size() + chunkSize - 1) / chunkSize);
+    const QByteArray header = CreateHeader(iv, chunkSize, chunkCount);
+
+    QVector<EncryptDecryptRequests::BatchItem> items(chunkCount);
+    for (int i = 0; i < chunkCount; ++i) {
+        EncryptDecryptRequests::BatchItem& item = items[i];
+        item.iv = CreateChunkIV(iv, i);
+        item.data = plainText.mid(i * chunkSize, chunkSize).toRawByteArray();
+        item.authCode = CreateChunkAuthData(header, i, i == chunkCount - 1);
+    }
+
+    trace.phase("encrypt");
+    const QVector<EncryptDecryptRequests::BatchResult> encrypted = EncryptDecryptRequests().encryptBatch(
+        encryptionKey, items, CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+        encryptionPluginName, windowSize);
+
+    trace.phase("serialize");
+    QByteArray envelope;
+    envelope.reserve(header.size() + plainText.size() + chunkCount * 32 + 1024);
+    envelope.append(header);
+    for (const auto& result : encrypted) {
+        AppendChunkRecord(&envelope, result);
+    }
+
+    trace.phase("sign");
+    envelope.append(SignEnvelope(
+        signingKey, EnvelopeDigest(ByteView(envelope)), signingPluginName,
+        signaturePadding, digestFunction));
+
+    return envelope;
+}
+
+QByteArray SealedMessages::open(
+    const Key& encryptionKey,
+    const Key& verifyingKey,
+    const ByteView& envelope,
+    const QString& encryptionPluginName,
+    const QString& verifyingPluginName,
+    const CryptoManager::SignaturePadding signaturePadding,
+    const CryptoManager::DigestFunction digestFunction,
+    const int windowSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    trace.phase("parse");
+    EnvelopeReader reader(envelope);
+    const ByteView magic = reader.bytes(ENVELOPE_MAGIC_SIZE);
+    const quint8 version = reader.uint8();
+    const quint32 chunkSize = reader.uint32();
+    const quint32 chunkCount = reader.uint32();
+    const ByteView iv = reader.bytes(reader.uint8());
+
+    if (reader.hasError() or
+        not IsValidHeader(magic, version, chunkSize, chunkCount, iv.size(),
+                          envelope.size() - reader.offset())) {
+        throw std::runtime_error("Bad envelope header");
+    }
+
+    const QByteArray ivData = iv.toRawByteArray();
+    const QByteArray header = envelope.mid(0, reader.offset()).toRawByteArray();
+
+    QVector<EncryptDecryptRequests::BatchItem> items(static_cast<int>(chunkCount));
+    int plainTextSize = 0;
+    for (int i = 0; i < items.size(); ++i) {
+        EncryptDecryptRequests::BatchItem& item = items[i];
+        item.data = reader.bytes(static_cast<int>(qMin<quint32>(reader.uint32(), INT_MAX))).toRawByteArray();
+        const quint8 tagSize = reader.uint8();
+        item.authTag = reader.bytes(GCM_TAG_SIZE).toRawByteArray();
+        if (reader.hasError()) {
+            break;
+        }
+
+        // An empty tag would skip the verification, so only full tags are accepted.
+        if (tagSize != GCM_TAG_SIZE) {
+            throw std::runtime_error("Bad envelope");
+        }
+
+        item.iv = CreateChunkIV(ivData, i);
+        item.authCode = CreateChunkAuthData(header, i, i == items.size() - 1);
+        plainTextSize += item.data.size();
+    }
+
+    const int bodySize = reader.offset();
+    const ByteView signature = reader.bytes(reader.uint16());
+
+    if (reader.hasError() or not reader.atEnd()) {
+        throw std::runtime_error("Bad envelope");
+    }
+
+    // The signature is verified while the chunks are decrypted.
+    trace.phase("verify and decrypt");
+    std::unique_ptr<VerifyRequest> verifyRequest(new VerifyRequest);
+    verifyRequest->setManager(Connections::cryptoManager());
+    verifyRequest->setKey(verifyingKey);
+    verifyRequest->setCryptoPluginName(verifyingPluginName);
+    verifyRequest->setPadding(signaturePadding);
+    verifyRequest->setDigestFunction(digestFunction);
+    verifyRequest->setSignature(signature.toRawByteArray());
+    verifyRequest->setData(EnvelopeDigest(envelope.mid(0, bodySize)));
+    verifyRequest->startRequest();
+
+    const QVector<EncryptDecryptRequests::BatchResult> decrypted = EncryptDecryptRequests().decryptBatch(
+        encryptionKey, items, CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+        encryptionPluginName, windowSize);
+
+    if (verifyRequest->status() != Request::Finished) {
+        QEventLoop loop;
+        QObject::connect(verifyRequest.get(), &VerifyRequest::statusChanged, &loop, [&] () {
+            if (verifyRequest->status() == Request::Finished) {
+                loop.quit();
+            }
+        });
+        if (verifyRequest->status() != Request::Finished) {
+            loop.exec();
+        }
+    }
+
+    if (not IsRequestWasSuccessful(verifyRequest.get())) {
+        throw std::runtime_error("Error when verifying envelope signature");
+    }
+
+    if (verifyRequest->verificationStatus() != CryptoManager::VerificationSucceeded) {
+        throw std::runtime_error("Bad envelope signature");
+    }
+
+    trace.phase("assemble");
+    QByteArray plainText;
+    plainText.reserve(plainTextSize);
+    for (const auto& result : decrypted) {
+        if (not result.succeeded) {
+            qDebug() << "Error when opening message:" << result.errorMessage;
+            throw std::runtime_error("Error when decrypt");
+        }
+        plainText.append(result.data);
+    }
+
+    return plainText;
+}
+
+void SealedMessages::sealStream(
+    const Key& encryptionKey,
+    const Key& signingKey,
+    QIODevice* input,
+    QIODevice* output,
+    const QString& encryptionPluginName,
+    const QString& signingPluginName,
+    const CryptoManager::SignaturePadding signaturePadding,
+    const CryptoManager::DigestFunction digestFunction,
+    const int chunkSize,
+    const int windowSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    if (chunkSize <= 0) {
+        throw std::runtime_error("Error when sealing message: bad chunk size");
+    }
+
+    if (not input or not output or input->isSequential()) {
+        throw std::runtime_error("Error when sealing message: input must be a random access device");
+    }
+
+    trace.phase("setup");
+    const QByteArray iv = CreateMessageIV(encryptionKey, encryptionPluginName);
+
+    const qint64 size = input->size() - input->pos();
+    const qint64 chunkCount = qMax<qint64>(1, (size + chunkSize - 1) / chunkSize);
+    if (chunkCount > INT_MAX) {
+        throw std::runtime_error("Error when sealing message: message is too large");
+    }
+
+    const QByteArray header = CreateHeader(iv, chunkSize, static_cast<int>(chunkCount));
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    digest.addData(header);
+    WriteOutput(output, header);
+
+    trace.phase("encrypt");
+    const int groupSize = qMax(1, windowSize);
+    for (int first = 0; first < chunkCount; first += groupSize) {
+        const int count = static_cast<int>(qMin<qint64>(groupSize, chunkCount - first));
+
+        QVector<EncryptDecryptRequests::BatchItem> items(count);
+        for (int i = 0; i < count; ++i) {
+            const int index = first + i;
+            const qint64 dataSize = qMin<qint64>(chunkSize, size - qint64(index) * chunkSize);
+
+            EncryptDecryptRequests::BatchItem& item = items[i];
+            item.data = input->read(dataSize);
+            if (item.data.size() != dataSize) {
+                throw std::runtime_error("Error when reading message");
+            }
+            item.iv = CreateChunkIV(iv, index);
+            item.authCode = CreateChunkAuthData(header, index, index == chunkCount - 1);
+        }
+
+        const QVector<EncryptDecryptRequests::BatchResult> encrypted = EncryptDecryptRequests().encryptBatch(
+            encryptionKey, items, CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+            encryptionPluginName, windowSize);
+
+        for (const auto& result : encrypted) {
+            QByteArray record;
+            AppendChunkRecord(&record, result);
+            digest.addData(record);
+            WriteOutput(output, record);
+        }
+    }
+
+    trace.phase("sign");
+    WriteOutput(output, SignEnvelope(
+        signingKey, digest.result(), signingPluginName, signaturePadding, digestFunction));
+}
+
+void SealedMessages::openStream(
+    const Key& encryptionKey,
+    const Key& verifyingKey,
+    QIODevice* input,
+    QIODevice* output,
+    const QString& encryptionPluginName,
+    const QString& verifyingPluginName,
+    const CryptoManager::SignaturePadding signaturePadding,
+    const CryptoManager::DigestFunction digestFunction,
+    const int windowSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    if (not input or not output or input->isSequential()) {
+        throw std::runtime_error("Error when opening message: input must be a random access device");
+    }
+
+    // The first pass only hashes the envelope, the chunks are read again to decrypt them.
+    trace.phase("verify");
+    const StreamHeader header = ReadHeader(input);
+    const qint64 bodyStart = input->pos();
+
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    digest.addData(header.header);
+    for (int i = 0; i < header.chunkCount; ++i) {
+        ReadChunkRecord(input, header.chunkSize, &digest);
+    }
+
+    const QByteArray signatureSize = ReadEnvelope(input, 2);
+    const QByteArray signature = ReadEnvelope(
+        input, qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(signatureSize.constData())));
+    if (not input->atEnd()) {
+        throw std::runtime_error("Bad envelope");
+    }
+
+    if (not SignVerifyRequests::verify(verifyingKey, digest.result(), signature,
+                                       verifyingPluginName, signaturePadding, digestFunction)) {
+        throw std::runtime_error("Bad envelope signature");
+    }
+
+    trace.phase("decrypt");
+    if (not input->seek(bodyStart)) {
+        throw std::runtime_error("Error when reading envelope");
+    }
+
+    const int groupSize = qMax(1, windowSize);
+    for (int first = 0; first < header.chunkCount; first += groupSize) {
+        const int count = qMin(groupSize, header.chunkCount - first);
+
+        QVector<EncryptDecryptRequests::BatchItem> items(count);
+        for (int i = 0; i < count; ++i) {
+            const int index = first + i;
+            items[i] = ReadChunkRecord(input, header.chunkSize, nullptr);
+            items[i].iv = CreateChunkIV(header.iv, index);
+            items[i].authCode = CreateChunkAuthData(header.header, index, index == header.chunkCount - 1);
+        }
+
+        const QVector<EncryptDecryptRequests::BatchResult> decrypted = EncryptDecryptRequests().decryptBatch(
+            encryptionKey, items, CryptoManager::BlockModeGcm, CryptoManager::EncryptionPaddingNone,
+            encryptionPluginName, windowSize);
+
+        for (const auto& result : decrypted) {
+            if (not result.succeeded) {
+                qDebug() << "Error when opening message:" << result.errorMessage;
+                throw std::runtime_error("Error when decrypt");
+            }
+            WriteOutput(output, result.data);
+        }
+    }
+}
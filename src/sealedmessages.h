@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QObject>
+
+class QIODevice;
+class ByteView;
+
+/*
+  Encrypt-then-sign messages in one envelope.
+  The plain text is split into chunks which are encrypted with AES-GCM by pipelined
+  requests. Every chunk has its own IV (the message IV with the chunk index xored into
+  its last four bytes) and authenticates the envelope header, its index and whether it
+  is the last one, so chunks can't be reordered, dropped or moved between messages.
+  The signature is made over the SHA-256 digest of the envelope, so the cipher text is
+  sent to the daemon only once.
+  Envelope format, integers are big endian:
+    "CSE1", version (1), chunk size (4), chunk count (4), IV size (1), IV,
+    for every chunk: cipher text size (4), cipher text, tag size (1, always 16), tag,
+    signature size (2), signature.
+ */
+class SealedMessages : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultChunkSize = 256 * 1024;
+    static const int DefaultWindowSize = 4;
+
+    /*
+      Throws std::runtime_error on error.
+     */
+    static QByteArray seal(
+        const Sailfish::Crypto::Key& encryptionKey,
+        const Sailfish::Crypto::Key& signingKey,
+        const ByteView& plainText,
+        const QString& encryptionPluginName,
+        const QString& signingPluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const int chunkSize = DefaultChunkSize,
+        const int windowSize = DefaultWindowSize);
+
+    /*
+      Verifies the signature while the chunks are decrypted, the plain text is returned
+      only if both succeeded. Throws std::runtime_error on error.
+     */
+    static QByteArray open(
+        const Sailfish::Crypto::Key& encryptionKey,
+        const Sailfish::Crypto::Key& verifyingKey,
+        const ByteView& envelope,
+        const QString& encryptionPluginName,
+        const QString& verifyingPluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const int windowSize = DefaultWindowSize);
+
+    /*
+      Same as seal() and open() for devices, only windowSize chunks are kept in memory
+      at a time. The input must be a random access device: the chunk count is written
+      to the header before the chunks, and openStream() reads the envelope twice, the
+      first pass verifies the signature and the second one decrypts, so no plain text
+      is written before the signature is verified. Every chunk is still verified by
+      its tag before it is written, but if openStream() throws (e.g. on a truncated
+      envelope) the output must be discarded.
+     */
+    static void sealStream(
+        const Sailfish::Crypto::Key& encryptionKey,
+        const Sailfish::Crypto::Key& signingKey,
+        QIODevice* input,
+        QIODevice* output,
+        const QString& encryptionPluginName,
+        const QString& signingPluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const int chunkSize = DefaultChunkSize,
+        const int windowSize = DefaultWindowSize);
+
+    static void openStream(
+        const Sailfish::Crypto::Key& encryptionKey,
+        const Sailfish::Crypto::Key& verifyingKey,
+        QIODevice* input,
+        QIODevice* output,
+        const QString& encryptionPluginName,
+        const QString& verifyingPluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding signaturePadding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const int windowSize = DefaultWindowSize);
+};
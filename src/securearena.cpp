@@ -0,0 +1,264 @@
+#include "securearena.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+namespace {
+
+    const int CLASS_COUNT = 9; // MinClassSize << 8 == MaxClassSize
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Arena {
+        QMutex mutex;
+        FreeBlock* freeLists[CLASS_COUNT] = {};
+        char* chunk = nullptr;
+        std::size_t chunkUsed = SecureArena::ChunkSize;
+        SecureArena::Statistics statistics;
+    };
+
+    Arena& GetArena()
+    {
+        static Arena arena;
+        return arena;
+    }
+
+    std::size_t PageSize()
+    {
+        static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+    }
+
+    /*
+      Must be called with the mutex locked.
+     */
+    char* MapLocked(Arena& arena, const std::size_t size)
+    {
+        void* const block = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        if (mlock(block, size) != 0) {
+            qDebug() << "Can't lock secure memory, it may be swapped out";
+            ++arena.statistics.lockFailures;
+        }
+
+#ifdef MADV_DONTDUMP
+        madvise(block, size, MADV_DONTDUMP);
+#endif
+
+        arena.statistics.mappedBytes += size;
+        return static_cast<char*>(block);
+    }
+
+    int SizeClass(const std::size_t size)
+    {
+        int sizeClass = 0;
+        while ((SecureArena::MinClassSize << sizeClass) < size) {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+} // anonymous namespace
+
+void SecureWipe(void* data, const std::size_t size)
+{
+    volatile char* p = static_cast<volatile char*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        p[i] = 0;
+    }
+}
+
+void* SecureArena::allocate(const std::size_t size, std::size_t* capacity)
+{
+    Arena& arena = GetArena();
+    QMutexLocker locker(&arena.mutex);
+
+    ++arena.statistics.allocations;
+
+    if (size > MaxClassSize) {
+        const std::size_t pageSize = PageSize();
+        *capacity = (size + pageSize - 1) / pageSize * pageSize;
+        return MapLocked(arena, *capacity);
+    }
+
+    const int sizeClass = SizeClass(size);
+    *capacity = MinClassSize << sizeClass;
+
+    if (FreeBlock* const block = arena.freeLists[sizeClass]) {
+        arena.freeLists[sizeClass] = block->next;
+        block->next = nullptr;
+        ++arena.statistics.freeListHits;
+        return block;
+    }
+
+    // Classes are powers of two, so blocks carved in order stay aligned.
+    if (arena.chunkUsed + *capacity > ChunkSize) {
+        arena.chunk = MapLocked(arena, ChunkSize);
+        arena.chunkUsed = 0;
+    }
+
+    void* const block = arena.chunk + arena.chunkUsed;
+    arena.chunkUsed += *capacity;
+    return block;
+}
+
+void SecureArena::release(void* block, const std::size_t capacity)
+{
+    if (not block) {
+        return;
+    }
+
+    SecureWipe(block, capacity);
+
+    Arena& arena = GetArena();
+    QMutexLocker locker(&arena.mutex);
+
+    ++arena.statistics.releases;
+
+    if (capacity > MaxClassSize) {
+        munlock(block, capacity);
+        munmap(block, capacity);
+        arena.statistics.mappedBytes -= capacity;
+        return;
+    }
+
+    FreeBlock* const freeBlock = static_cast<FreeBlock*>(block);
+    const int sizeClass = SizeClass(capacity);
+    freeBlock->next = arena.freeLists[sizeClass];
+    arena.freeLists[sizeClass] = freeBlock;
+}
+
+SecureArena::Statistics SecureArena::statistics()
+{
+    Arena& arena = GetArena();
+    QMutexLocker locker(&arena.mutex);
+    return arena.statistics;
+}
+
+SecureBuffer::SecureBuffer()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_capacity(0)
+{
+}
+
+SecureBuffer::SecureBuffer(const ByteView& data)
+    : SecureBuffer()
+{
+    append(data);
+}
+
+SecureBuffer::SecureBuffer(SecureBuffer&& other)
+    : m_data(other.m_data)
+    , m_size(other.m_size)
+    , m_capacity(other.m_capacity)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_capacity = 0;
+}
+
+SecureBuffer& SecureBuffer::operator=(SecureBuffer&& other)
+{
+    if (this != &other) {
+        release();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_capacity = other.m_capacity;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_capacity = 0;
+    }
+    return *this;
+}
+
+SecureBuffer::~SecureBuffer()
+{
+    release();
+}
+
+void SecureBuffer::reserve(const int capacity)
+{
+    if (capacity <= 0 or static_cast<std::size_t>(capacity) <= m_capacity) {
+        return;
+    }
+
+    std::size_t newCapacity = 0;
+    char* const newData = static_cast<char*>(
+        SecureArena::allocate(static_cast<std::size_t>(capacity), &newCapacity));
+
+    if (m_size > 0) {
+        std::memcpy(newData, m_data, m_size);
+    }
+
+    SecureArena::release(m_data, m_capacity);
+    m_data = newData;
+    m_capacity = newCapacity;
+}
+
+void SecureBuffer::resize(const int size)
+{
+    const int newSize = qMax(size, 0);
+    if (newSize > m_size) {
+        reserve(newSize);
+        std::memset(m_data + m_size, 0, newSize - m_size);
+    } else if (newSize < m_size) {
+        SecureWipe(m_data + newSize, m_size - newSize);
+    }
+    m_size = newSize;
+}
+
+/*
+  Grows by doubling, the same as QByteArray, so appending chunks is amortized.
+ */
+void SecureBuffer::append(const ByteView& data)
+{
+    if (data.size() <= 0) {
+        return;
+    }
+
+    const int required = m_size + data.size();
+    if (static_cast<std::size_t>(required) > m_capacity) {
+        reserve(qMax(required, 2 * static_cast<int>(m_capacity)));
+    }
+
+    std::memcpy(m_data + m_size, data.data(), data.size());
+    m_size = required;
+}
+
+void SecureBuffer::clear()
+{
+    if (m_data) {
+        SecureWipe(m_data, m_size);
+    }
+    m_size = 0;
+}
+
+void SecureBuffer::assignAndWipe(QByteArray& data)
+{
+    clear();
+    append(ByteView(data));
+    SecureWipe(data.data(), data.size());
+    data.clear();
+}
+
+void SecureBuffer::release()
+{
+    SecureArena::release(m_data, m_capacity);
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "byteview.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <cstddef>
+
+/*
+  Overwrites memory with zeros, the compiler can't optimize it out.
+ */
+void SecureWipe(void* data, const std::size_t size);
+
+/*
+  Allocator for plaintexts and key material.
+  Memory is taken from mlock()ed pages, so it is never swapped out, and it is excluded
+  from core dumps. Blocks up to MaxClassSize bytes are served from power of two size
+  classes with free lists carved from ChunkSize mappings which are kept for the whole
+  process life, so steady-state allocations do not map or lock anything. Larger blocks
+  get their own mapping. Every block is wiped on release.
+  If the locked memory limit is reached, pages are used unlocked and lockFailures is
+  increased.
+ */
+class SecureArena : public QObject {
+    Q_OBJECT
+
+public:
+    static const std::size_t MinClassSize = 16;
+    static const std::size_t MaxClassSize = 4096;
+    static const std::size_t ChunkSize = 64 * 1024;
+
+    struct Statistics {
+        quint64 allocations = 0;
+        quint64 releases = 0;
+        quint64 freeListHits = 0;
+        quint64 mappedBytes = 0;
+        quint64 lockFailures = 0;
+    };
+
+    /*
+      Returns a block of at least size bytes and stores its real size to capacity.
+      Throws std::bad_alloc if memory can't be mapped.
+     */
+    static void* allocate(const std::size_t size, std::size_t* capacity);
+
+    /*
+      Wipes and releases the block, capacity must be the one returned by allocate().
+     */
+    static void release(void* block, const std::size_t capacity);
+
+    static Statistics statistics();
+};
+
+/*
+  Byte buffer in SecureArena memory. It can't be copied, only moved, and is wiped when
+  it is cleared, reallocated or destroyed.
+ */
+class SecureBuffer {
+public:
+    SecureBuffer();
+    explicit SecureBuffer(const ByteView& data);
+    SecureBuffer(SecureBuffer&& other);
+    SecureBuffer& operator=(SecureBuffer&& other);
+    ~SecureBuffer();
+
+    char* data() { return m_data; }
+    const char* constData() const { return m_data; }
+    int size() const { return m_size; }
+    int capacity() const { return static_cast<int>(m_capacity); }
+    bool isEmpty() const { return m_size == 0; }
+
+    ByteView view() const { return ByteView(m_data, m_size); }
+
+    void reserve(const int capacity);
+    void resize(const int size);
+    void append(const ByteView& data);
+
+    /*
+      Wipes the content keeping the memory.
+     */
+    void clear();
+
+    /*
+      Replaces the content with data and wipes data, so the only copy of it is
+      in the locked memory. data must not be shared with other QByteArrays.
+     */
+    void assignAndWipe(QByteArray& data);
+
+private:
+    SecureBuffer(const SecureBuffer&) = delete;
+    SecureBuffer& operator=(const SecureBuffer&) = delete;
+
+    void release();
+
+    char* m_data;
+    int m_size;
+    std::size_t m_capacity;
+};
@@ -0,0 +1,316 @@
+#include "signverifyexecutor.h"
+#include "utils.h"
+#include "connections.h"
+
+#include <Sailfish/Crypto/signrequest.h>
+#include <Sailfish/Crypto/verifyrequest.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QEvent>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTimer>
+
+using namespace Sailfish::Crypto;
+
+namespace {
+
+    const QEvent::Type WAKE_EVENT = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+    // How often an idle worker looks for jobs to steal while there are unfinished jobs.
+    const int STEAL_INTERVAL = 10; // milliseconds
+
+} // anonymous namespace
+
+/*
+  Lives in its own thread, all its methods are called from that thread.
+  A worker is woken by a WAKE_EVENT when a job is put in its own queue. While the
+  executor has unfinished jobs it also polls the other queues on a timer, so idle
+  workers steal without every submit waking every worker.
+ */
+class SignVerifyExecutor::Worker : public QObject {
+public:
+    Worker(SignVerifyExecutor* executor, const int index)
+        : m_executor(executor)
+        , m_index(index)
+        , m_inFlight(0)
+        , m_stealTimer(this)
+    {
+        m_stealTimer.setInterval(STEAL_INTERVAL);
+        connect(&m_stealTimer, &QTimer::timeout, this, [this] () {
+            schedule();
+            if (not m_executor->hasPendingJobs()) {
+                m_stealTimer.stop();
+            }
+        });
+    }
+
+    bool event(QEvent* event) override
+    {
+        if (event->type() != WAKE_EVENT) {
+            return QObject::event(event);
+        }
+
+        schedule();
+        if (not m_stealTimer.isActive()) {
+            m_stealTimer.start();
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        m_stealTimer.stop();
+    }
+
+    void schedule()
+    {
+        while (m_inFlight < m_executor->m_windowSize) {
+            std::shared_ptr<Task> task(new Task);
+            if (not m_executor->takeTask(m_index, task.get())) {
+                return;
+            }
+
+            ++m_inFlight;
+            if (task->job.operation == Job::Sign) {
+                startSign(task);
+            } else {
+                startVerify(task);
+            }
+        }
+    }
+
+private:
+    void startSign(const std::shared_ptr<Task>& task)
+    {
+        const Job& job = task->job;
+
+        SignRequest* const request = new SignRequest;
+        request->setManager(Connections::cryptoManager());
+        request->setKey(job.key);
+        request->setCryptoPluginName(job.pluginName);
+        request->setPadding(job.padding);
+        request->setDigestFunction(job.digestFunction);
+        request->setData(job.data);
+
+        connect(request, &SignRequest::statusChanged, this, [this, request, task] () {
+            if (request->status() != Request::Finished) {
+                return;
+            }
+
+            JobResult result;
+            result.succeeded = IsRequestWasSuccessful(request);
+            if (result.succeeded) {
+                result.signature = request->signature();
+            }
+
+            request->deleteLater();
+            finish(*task, result);
+        });
+
+        request->startRequest();
+    }
+
+    void startVerify(const std::shared_ptr<Task>& task)
+    {
+        const Job& job = task->job;
+
+        VerifyRequest* const request = new VerifyRequest;
+        request->setManager(Connections::cryptoManager());
+        request->setKey(job.key);
+        request->setCryptoPluginName(job.pluginName);
+        request->setPadding(job.padding);
+        request->setDigestFunction(job.digestFunction);
+        request->setSignature(job.signature);
+        request->setData(job.data);
+
+        connect(request, &VerifyRequest::statusChanged, this, [this, request, task] () {
+            if (request->status() != Request::Finished) {
+                return;
+            }
+
+            JobResult result;
+            result.succeeded = IsRequestWasSuccessful(request);
+            result.verified =
+                result.succeeded and
+                request->verificationStatus() == CryptoManager::VerificationSucceeded;
+
+            request->deleteLater();
+            finish(*task, result);
+        });
+
+        request->startRequest();
+    }
+
+    void finish(Task& task, const JobResult& result)
+    {
+        m_executor->completeTask(task, result);
+        --m_inFlight;
+        schedule();
+    }
+
+    SignVerifyExecutor* const m_executor;
+    const int m_index;
+    int m_inFlight;
+    QTimer m_stealTimer;
+};
+
+SignVerifyExecutor::SignVerifyExecutor(const int threadCount,
+                                       const int windowSize,
+                                       QObject* parent)
+    : QObject(parent)
+    , m_windowSize(qMax(windowSize, 1))
+    , m_nextQueue(0)
+    , m_stolenJobs(0)
+    , m_pendingJobs(0)
+{
+    const int count = threadCount > 0 ? threadCount : qMax(QThread::idealThreadCount(), 1);
+
+    for (int i = 0; i < count; ++i) {
+        m_queues.emplace_back(new Queue);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        QThread* const thread = new QThread;
+        Worker* const worker = new Worker(this, i);
+        worker->moveToThread(thread);
+
+        // The timer has to be stopped in the thread which started it.
+        connect(thread, &QThread::finished, worker, [worker] () {
+            worker->stop();
+        }, Qt::DirectConnection);
+
+        m_threads.push_back(thread);
+        m_workers.push_back(worker);
+        thread->start();
+    }
+}
+
+SignVerifyExecutor::~SignVerifyExecutor()
+{
+    waitForDone();
+
+    for (QThread* const thread : m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+
+    for (Worker* const worker : m_workers) {
+        delete worker;
+    }
+
+    for (QThread* const thread : m_threads) {
+        delete thread;
+    }
+}
+
+QFuture<SignVerifyExecutor::JobResult> SignVerifyExecutor::submit(const Job& job)
+{
+    Task task;
+    task.job = job;
+    task.promise.reportStarted();
+    const QFuture<JobResult> future = task.promise.future();
+
+    bool firstJob = false;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        firstJob = m_pendingJobs++ == 0;
+    }
+
+    const std::size_t index = m_nextQueue++ % m_queues.size();
+    Queue& queue = *m_queues[index];
+    {
+        QMutexLocker locker(&queue.mutex);
+        queue.tasks.push_back(task);
+    }
+
+    // Only the owner of the queue is woken. The first job after the executor was idle
+    // also wakes the others, so that they start looking for jobs to steal.
+    if (firstJob) {
+        for (Worker* const worker : m_workers) {
+            QCoreApplication::postEvent(worker, new QEvent(WAKE_EVENT));
+        }
+    } else {
+        QCoreApplication::postEvent(m_workers[index], new QEvent(WAKE_EVENT));
+    }
+
+    return future;
+}
+
+void SignVerifyExecutor::waitForDone()
+{
+    QMutexLocker locker(&m_pendingMutex);
+    while (m_pendingJobs > 0) {
+        m_pendingDone.wait(&m_pendingMutex);
+    }
+}
+
+bool SignVerifyExecutor::hasPendingJobs()
+{
+    QMutexLocker locker(&m_pendingMutex);
+    return m_pendingJobs > 0;
+}
+
+int SignVerifyExecutor::threadCount() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+quint64 SignVerifyExecutor::stolenJobs() const
+{
+    return m_stolenJobs.load();
+}
+
+/*
+  Own queue is served from the front. An empty worker steals from the back of the
+  longest queue, the back is the least likely to be taken by its owner soon.
+ */
+bool SignVerifyExecutor::takeTask(const int workerIndex, Task* task)
+{
+    {
+        Queue& own = *m_queues[workerIndex];
+        QMutexLocker locker(&own.mutex);
+        if (not own.tasks.empty()) {
+            *task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    while (true) {
+        Queue* victim = nullptr;
+        std::size_t victimSize = 0;
+
+        for (const auto& queue : m_queues) {
+            QMutexLocker locker(&queue->mutex);
+            if (queue->tasks.size() > victimSize) {
+                victim = queue.get();
+                victimSize = queue->tasks.size();
+            }
+        }
+
+        if (not victim) {
+            return false;
+        }
+
+        QMutexLocker locker(&victim->mutex);
+        // The queue could be emptied since it was measured, then look for another one.
+        if (not victim->tasks.empty()) {
+            *task = victim->tasks.back();
+            victim->tasks.pop_back();
+            ++m_stolenJobs;
+            return true;
+        }
+    }
+}
+
+void SignVerifyExecutor::completeTask(Task& task, const JobResult& result)
+{
+    task.promise.reportResult(result);
+    task.promise.reportFinished();
+
+    QMutexLocker locker(&m_pendingMutex);
+    if (--m_pendingJobs == 0) {
+        m_pendingDone.wakeAll();
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Sailfish/Crypto/cryptomanager.h>
+#include <Sailfish/Crypto/key.h>
+
+#include <QtCore/QFuture>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/*
+  Runs sign and verify jobs on a pool of worker threads.
+  Every worker has its own event loop and its own daemon connection (see Connections)
+  and keeps up to windowSize requests in flight. Submitted jobs are spread over the
+  workers' queues round robin and only the owner of the queue is woken, a worker which
+  has run out of jobs steals them from the back of the longest other queue, so a slow
+  worker does not hold jobs back.
+  submit() may be called from any thread and never blocks, the job is completed
+  through the returned future.
+ */
+class SignVerifyExecutor : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultWindowSize = 4;
+
+    struct Job {
+        enum Operation {
+            Sign,
+            Verify
+        };
+
+        Operation operation = Sign;
+        Sailfish::Crypto::Key key;
+        QByteArray data;
+        QByteArray signature; // verify only
+        QString pluginName;
+        Sailfish::Crypto::CryptoManager::SignaturePadding padding =
+            Sailfish::Crypto::CryptoManager::SignaturePaddingNone;
+        Sailfish::Crypto::CryptoManager::DigestFunction digestFunction =
+            Sailfish::Crypto::CryptoManager::DigestSha256;
+    };
+
+    struct JobResult {
+        bool succeeded = false; // the request was finished without errors
+        QByteArray signature; // sign only
+        bool verified = false; // verify only
+    };
+
+    /*
+      threadCount 0 means QThread::idealThreadCount().
+     */
+    explicit SignVerifyExecutor(const int threadCount = 0,
+                                const int windowSize = DefaultWindowSize,
+                                QObject* parent = nullptr);
+
+    /*
+      Waits for all submitted jobs and stops the workers.
+     */
+    ~SignVerifyExecutor();
+
+    QFuture<JobResult> submit(const Job& job);
+
+    /*
+      Blocks until all submitted jobs are completed.
+     */
+    void waitForDone();
+
+    int threadCount() const;
+    quint64 stolenJobs() const;
+
+private:
+    class Worker;
+
+    struct Task {
+        Job job;
+        QFutureInterface<JobResult> promise;
+    };
+
+    struct Queue {
+        QMutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool takeTask(const int workerIndex, Task* task);
+    bool hasPendingJobs();
+    void completeTask(Task& task, const JobResult& result);
+
+    const int m_windowSize;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<QThread*> m_threads;
+    std::vector<Worker*> m_workers;
+    std::atomic<unsigned> m_nextQueue;
+    std::atomic<quint64> m_stolenJobs;
+
+    QMutex m_pendingMutex;
+    QWaitCondition m_pendingDone;
+    quint64 m_pendingJobs;
+};
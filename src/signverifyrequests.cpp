@@ -1,38 +1,121 @@
 #include "signverifyrequests.h"
+#include "byteview.h"
 #include "utils.h"
+#include "connections.h"
+#include "asyncrequest.h"
+#include "batchrequest.h"
+#include "localplugins.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <Sailfish/Crypto/signrequest.h>
 #include <Sailfish/Crypto/verifyrequest.h>
 #include <Sailfish/Crypto/generatestoredkeyrequest.h>
+#include <Sailfish/Crypto/Plugins/extensionplugins.h>
 
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
+#include <QtCore/QHash>
 
 using namespace Sailfish::Crypto;
 
+namespace {
+
+    void SetupSignRequest(SignRequest& request,
+                          const Key& key,
+                          const QByteArray& data,
+                          const QString& pluginName,
+                          const CryptoManager::SignaturePadding padding,
+                          const CryptoManager::DigestFunction digestFunction)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setKey(key);
+        request.setCryptoPluginName(pluginName);
+        request.setPadding(padding);
+        request.setDigestFunction(digestFunction);
+        request.setData(data);
+    }
+
+    void SetupVerifyRequest(VerifyRequest& request,
+                            const Key& key,
+                            const QByteArray& data,
+                            const QByteArray& signature,
+                            const QString& pluginName,
+                            const CryptoManager::SignaturePadding padding,
+                            const CryptoManager::DigestFunction digestFunction)
+    {
+        request.setManager(Connections::cryptoManager());
+        request.setKey(key);
+        request.setCryptoPluginName(pluginName);
+        request.setPadding(padding);
+        request.setDigestFunction(digestFunction);
+        request.setSignature(signature);
+        request.setData(data);
+    }
+
+    /*
+      Stored keys are the same when their identifiers are, other keys when the digest
+      of all their key data is. The key data itself is not used, so secret key material
+      is not copied into the hash table.
+     */
+    QByteArray KeyGroupId(const Key& key)
+    {
+        const Key::Identifier identifier = key.identifier();
+        if (not identifier.name().isEmpty()) {
+            return (identifier.name() + QLatin1Char('/') + identifier.collectionName() +
+                    QLatin1Char('/') + identifier.storagePluginName()).toUtf8();
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        for (const QByteArray& data : { key.publicKey(), key.privateKey(), key.secretKey() }) {
+            hash.addData(QByteArray::number(data.size()) + ':');
+            hash.addData(data);
+        }
+
+        return QByteArray::number(static_cast<int>(key.algorithm())) + ':' + hash.result();
+    }
+
+} // anonymous namespace
+
 QByteArray SignVerifyRequests::sign(const Sailfish::Crypto::Key& key,
                                     const QByteArray& data,
                                     const QString& pluginName,
                                     const CryptoManager::SignaturePadding padding,
                                     const CryptoManager::DigestFunction digestFunction)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
+
+    MetricsScope metrics("sign", Metrics::algorithmName(key.algorithm()), pluginName, data.size());
+
+    if (CryptoPlugin* const plugin = LocalPlugins::pluginForKey(key, pluginName)) {
+        QByteArray signature;
+        const Result result = plugin->sign(
+            data, key, padding, digestFunction, QVariantMap(), &signature);
+
+        if (not IsResultWasSuccessful(result)) {
+            return {};
+        }
 
-    CryptoManager manager;
+        metrics.setSucceeded(signature.size());
+        return signature;
+    }
+
+    trace.phase("setup");
     SignRequest request;
-    request.setManager(&manager);
-    request.setKey(key);
-    request.setCryptoPluginName(pluginName);
-    request.setPadding(padding);
-    request.setDigestFunction(digestFunction);
-    request.setData(data);
+    SetupSignRequest(request, key, data, pluginName, padding, digestFunction);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         return {};
     }
 
-    return request.signature();
+    const QByteArray signature = request.signature();
+    metrics.setSucceeded(signature.size());
+    return signature;
 }
 
 bool SignVerifyRequests::verify(const Sailfish::Crypto::Key& key,
@@ -42,23 +125,163 @@ bool SignVerifyRequests::verify(const Sailfish::Crypto::Key& key,
                                 const CryptoManager::SignaturePadding padding,
                                 const CryptoManager::DigestFunction digestFunction)
 {
-    qDebug() << Q_FUNC_INFO;
+    TraceScope trace(Q_FUNC_INFO);
+
+    MetricsScope metrics("verify", Metrics::algorithmName(key.algorithm()), pluginName,
+                         data.size() + signature.size());
+
+    if (CryptoPlugin* const plugin = LocalPlugins::pluginForKey(key, pluginName)) {
+        CryptoManager::VerificationStatus status = CryptoManager::VerificationStatusUnknown;
+        const Result result = plugin->verify(
+            signature, data, key, padding, digestFunction, QVariantMap(), &status);
+
+        if (not IsResultWasSuccessful(result)) {
+            return {};
+        }
+
+        metrics.setSucceeded();
+        return status == CryptoManager::VerificationSucceeded;
+    }
 
-    CryptoManager manager;
+    trace.phase("setup");
     VerifyRequest request;
-    request.setManager(&manager);
-    request.setKey(key);
-    request.setCryptoPluginName(pluginName);
-    request.setPadding(padding);
-    request.setDigestFunction(digestFunction);
-    request.setSignature(signature);
-    request.setData(data);
+    SetupVerifyRequest(request, key, data, signature, pluginName, padding, digestFunction);
+    trace.phase("startRequest");
     request.startRequest();
+    trace.phase("waitForFinished");
     request.waitForFinished();
+    trace.phase("result");
 
     if (not IsRequestWasSuccessful(&request)) {
         return {};
     }
 
+    metrics.setSucceeded();
     return request.verificationStatus() == CryptoManager::VerificationSucceeded;
 }
+
+bool SignVerifyRequests::sign(const Sailfish::Crypto::Key& key,
+                              const ByteView& data,
+                              QByteArray* signature,
+                              const QString& pluginName,
+                              const CryptoManager::SignaturePadding padding,
+                              const CryptoManager::DigestFunction digestFunction)
+{
+    AssignToOutputBuffer(signature, sign(key, data.toRawByteArray(), pluginName, padding,
+                                         digestFunction));
+    return not signature->isEmpty();
+}
+
+bool SignVerifyRequests::verify(const Sailfish::Crypto::Key& key,
+                                const ByteView& data,
+                                const ByteView& signature,
+                                const QString& pluginName,
+                                const CryptoManager::SignaturePadding padding,
+                                const CryptoManager::DigestFunction digestFunction)
+{
+    return verify(key, data.toRawByteArray(), signature.toRawByteArray(),
+                  pluginName, padding, digestFunction);
+}
+
+QFuture<QByteArray> SignVerifyRequests::signAsync(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& data,
+    const QString& pluginName,
+    const CryptoManager::SignaturePadding padding,
+    const CryptoManager::DigestFunction digestFunction)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    SignRequest* const request = new SignRequest;
+    SetupSignRequest(*request, key, data, pluginName, padding, digestFunction);
+
+    return StartAsyncRequest<QByteArray>(
+        request,
+        [] (const SignRequest& finished) {
+            return finished.signature();
+        },
+        nullptr);
+}
+
+QFuture<bool> SignVerifyRequests::verifyAsync(
+    const Sailfish::Crypto::Key& key,
+    const QByteArray& data,
+    const QByteArray& signature,
+    const QString& pluginName,
+    const CryptoManager::SignaturePadding padding,
+    const CryptoManager::DigestFunction digestFunction)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    VerifyRequest* const request = new VerifyRequest;
+    SetupVerifyRequest(*request, key, data, signature, pluginName, padding, digestFunction);
+
+    return StartAsyncRequest<bool>(
+        request,
+        [] (const VerifyRequest& finished) {
+            return finished.verificationStatus() == CryptoManager::VerificationSucceeded;
+        },
+        nullptr);
+}
+
+QVector<SignVerifyRequests::BatchVerifyResult> SignVerifyRequests::verifyBatch(
+    const QVector<BatchVerifyItem>& items,
+    const QString& pluginName,
+    const CryptoManager::SignaturePadding padding,
+    const CryptoManager::DigestFunction digestFunction,
+    const int windowSize)
+{
+    TraceScope trace(Q_FUNC_INFO);
+
+    // Group item indexes by key keeping the order of the first appearance of every key.
+    QHash<QByteArray, int> groupIndexes;
+    QVector<Key> groupKeys;
+    QVector<QVector<int>> groups;
+    for (int i = 0; i < items.size(); ++i) {
+        const QByteArray groupId = KeyGroupId(items.at(i).key);
+        auto it = groupIndexes.constFind(groupId);
+        if (it == groupIndexes.constEnd()) {
+            it = groupIndexes.insert(groupId, groups.size());
+            groupKeys.append(CreateBatchKey(items.at(i).key));
+            groups.append(QVector<int>());
+        }
+        groups[*it].append(i);
+    }
+
+    QVector<int> order;
+    QVector<int> orderGroups;
+    order.reserve(items.size());
+    orderGroups.reserve(items.size());
+    for (int group = 0; group < groups.size(); ++group) {
+        for (const int index : groups.at(group)) {
+            order.append(index);
+            orderGroups.append(group);
+        }
+    }
+
+    QVector<BatchVerifyResult> results(items.size());
+
+    RunRequestBatch<VerifyRequest>(
+        order.size(),
+        windowSize,
+        [&] (const int position) {
+            const BatchVerifyItem& item = items.at(order.at(position));
+            VerifyRequest* const request = new VerifyRequest;
+            SetupVerifyRequest(*request, groupKeys.at(orderGroups.at(position)), item.data,
+                               item.signature, pluginName, padding, digestFunction);
+            return request;
+        },
+        [&] (const int position, VerifyRequest& request) {
+            BatchVerifyResult& result = results[order.at(position)];
+            if (not IsRequestWasSuccessful(&request)) {
+                result.status = BatchVerifyError;
+                result.errorMessage = request.result().errorMessage();
+            } else if (request.verificationStatus() == CryptoManager::VerificationSucceeded) {
+                result.status = BatchVerifySucceeded;
+            } else {
+                result.status = BatchVerifyBadSignature;
+            }
+        });
+
+    return results;
+}
@@ -2,10 +2,34 @@
 
 #include <Sailfish/Crypto/key.h>
 
+#include <QtCore/QFuture>
+#include <QtCore/QVector>
+
+class ByteView;
+
 class SignVerifyRequests : public QObject {
     Q_OBJECT
 
 public:
+    static const int DefaultBatchWindowSize = 8;
+
+    enum BatchVerifyStatus {
+        BatchVerifySucceeded,
+        BatchVerifyBadSignature, // the request was finished, the signature doesn't match
+        BatchVerifyError // the request failed, see errorMessage
+    };
+
+    struct BatchVerifyItem {
+        Sailfish::Crypto::Key key;
+        QByteArray data;
+        QByteArray signature;
+    };
+
+    struct BatchVerifyResult {
+        BatchVerifyStatus status = BatchVerifyError;
+        QString errorMessage;
+    };
+
     static QByteArray sign(const Sailfish::Crypto::Key& key,
                            const QByteArray& data,
                            const QString& pluginName,
@@ -18,4 +42,50 @@ public:
                        const QString& pluginName,
                        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
                        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    /*
+      Same as sign() and verify() for data in the caller's memory, it is passed to the
+      request without copying. sign() returns false on error, the signature is copied
+      into the memory the buffer already owns when it fits.
+     */
+    static bool sign(const Sailfish::Crypto::Key& key,
+                     const ByteView& data,
+                     QByteArray* signature,
+                     const QString& pluginName,
+                     const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+                     const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    static bool verify(const Sailfish::Crypto::Key& key,
+                       const ByteView& data,
+                       const ByteView& signature,
+                       const QString& pluginName,
+                       const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+                       const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    static QFuture<QByteArray> signAsync(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& data,
+        const QString& pluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    static QFuture<bool> verifyAsync(
+        const Sailfish::Crypto::Key& key,
+        const QByteArray& data,
+        const QByteArray& signature,
+        const QString& pluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction);
+
+    /*
+      Verifies all items keeping windowSize requests in flight and returns results in
+      the order of items. Items are sent grouped by key, so requests of one key follow
+      each other and every distinct key is prepared once.
+     */
+    static QVector<BatchVerifyResult> verifyBatch(
+        const QVector<BatchVerifyItem>& items,
+        const QString& pluginName,
+        const Sailfish::Crypto::CryptoManager::SignaturePadding padding,
+        const Sailfish::Crypto::CryptoManager::DigestFunction digestFunction,
+        const int windowSize = DefaultBatchWindowSize);
 };
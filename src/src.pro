@@ -4,7 +4,10 @@ target.path = /usr/bin
 QT -= gui
 CONFIG += c++11 link_pkgconfig warn_on debug
 QMAKE_CXXFLAGS += -Wall -Wextra -Werror -pedantic -g
-PKGCONFIG += sailfishcrypto sailfishsecrets
+PKGCONFIG += sailfishcrypto sailfishsecrets sailfishcryptopluginapi nettle
+
+# Build with CONFIG+=no_tracing to compile trace events out.
+no_tracing: DEFINES += CRYPTOS_NO_TRACING
 
 SOURCES += cryptos.cpp \
     requests.cpp \
@@ -14,7 +17,23 @@ SOURCES += cryptos.cpp \
     generatekeyrequests.cpp \
     createivrequests.cpp \
     cipherdecipherrequests.cpp \
-    digestrequests.cpp
+    digestrequests.cpp \
+    cipherpipeline.cpp \
+    connections.cpp \
+    keycache.cpp \
+    ivpool.cpp \
+    randompool.cpp \
+    mappedfile.cpp \
+    localplugins.cpp \
+    metrics.cpp \
+    trace.cpp \
+    kdfcalibration.cpp \
+    keypairpool.cpp \
+    signverifyexecutor.cpp \
+    metadatacache.cpp \
+    securearena.cpp \
+    sealedmessages.cpp \
+    envelopeencryption.cpp
 
 HEADERS += requests.h \
     requests.h \
@@ -24,6 +43,26 @@ HEADERS += requests.h \
     generatekeyrequests.h \
     createivrequests.h \
     cipherdecipherrequests.h \
-    digestrequests.h
+    digestrequests.h \
+    cipherpipeline.h \
+    connections.h \
+    asyncrequest.h \
+    batchrequest.h \
+    keycache.h \
+    ivpool.h \
+    randompool.h \
+    mappedfile.h \
+    localplugins.h \
+    metrics.h \
+    trace.h \
+    kdfcalibration.h \
+    keypairpool.h \
+    signverifyexecutor.h \
+    metadatacache.h \
+    byteview.h \
+    securearena.h \
+    sealedmessages.h \
+    envelopeformat.h \
+    envelopeencryption.h
 
 INSTALLS += target
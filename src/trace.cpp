@@ -0,0 +1,227 @@
+#include "trace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+
+#include <chrono>
+#include <vector>
+
+std::atomic<bool> Trace::s_enabled(false);
+
+namespace {
+
+    const char PHASE_BEGIN = 'B';
+    const char PHASE_END = 'E';
+
+    /*
+      Every field is atomic, so the exporter can read events while the owner thread
+      overwrites them. sequence is odd while the event is being written and
+      2 * (position + 1) when the event at position is complete.
+     */
+    struct Event {
+        std::atomic<quint64> sequence;
+        std::atomic<const char*> name;
+        std::atomic<qint64> timestamp;
+        std::atomic<char> phase;
+    };
+
+    struct ThreadBuffer {
+        int threadId = 0;
+        std::atomic<quint64> head;
+        Event events[Trace::RingBufferSize];
+    };
+
+    /*
+      Buffers of finished threads are kept on the free list with their events, so they
+      can still be exported, until a new thread reuses them. So the number of buffers is
+      bounded by the number of threads which trace at the same time.
+     */
+    struct Registry {
+        QMutex mutex;
+        std::vector<ThreadBuffer*> buffers; // never freed, threads may outlive statics
+        std::vector<ThreadBuffer*> freeBuffers;
+        int nextThreadId = 1;
+    };
+
+    Registry& GetRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    /*
+      Must be called with the registry mutex locked.
+     */
+    void ResetBuffer(ThreadBuffer* buffer)
+    {
+        buffer->head.store(0, std::memory_order_relaxed);
+        for (auto& event : buffer->events) {
+            event.sequence.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ThreadBuffer* AcquireThreadBuffer()
+    {
+        Registry& registry = GetRegistry();
+        QMutexLocker locker(&registry.mutex);
+
+        ThreadBuffer* buffer = nullptr;
+        if (not registry.freeBuffers.empty()) {
+            buffer = registry.freeBuffers.back();
+            registry.freeBuffers.pop_back();
+        } else {
+            buffer = new ThreadBuffer;
+            registry.buffers.push_back(buffer);
+        }
+
+        ResetBuffer(buffer);
+        buffer->threadId = registry.nextThreadId++;
+        return buffer;
+    }
+
+    void ReleaseThreadBuffer(ThreadBuffer* buffer)
+    {
+        Registry& registry = GetRegistry();
+        QMutexLocker locker(&registry.mutex);
+        registry.freeBuffers.push_back(buffer);
+    }
+
+    /*
+      Returns the buffer of the thread to the registry when the thread exits.
+     */
+    struct ThreadBufferOwner {
+        ThreadBufferOwner()
+            : buffer(AcquireThreadBuffer())
+        {
+        }
+
+        ~ThreadBufferOwner()
+        {
+            ReleaseThreadBuffer(buffer);
+        }
+
+        ThreadBuffer* const buffer;
+    };
+
+    ThreadBuffer* GetThreadBuffer()
+    {
+        thread_local ThreadBufferOwner owner;
+        return owner.buffer;
+    }
+
+    qint64 Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Record(const char* name, const char phase)
+    {
+        ThreadBuffer* const buffer = GetThreadBuffer();
+        const quint64 position = buffer->head.load(std::memory_order_relaxed);
+        Event& event = buffer->events[position % Trace::RingBufferSize];
+
+        event.sequence.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        event.name.store(name, std::memory_order_relaxed);
+        event.timestamp.store(Now(), std::memory_order_relaxed);
+        event.phase.store(phase, std::memory_order_relaxed);
+        event.sequence.store(2 * (position + 1), std::memory_order_release);
+
+        buffer->head.store(position + 1, std::memory_order_release);
+    }
+
+    void ExportBuffer(ThreadBuffer* buffer, const qint64 processId, QJsonArray* events)
+    {
+        const quint64 head = buffer->head.load(std::memory_order_acquire);
+        const quint64 size = static_cast<quint64>(Trace::RingBufferSize);
+        const quint64 first = head > size ? head - size : 0;
+
+        for (quint64 position = first; position < head; ++position) {
+            const Event& event = buffer->events[position % size];
+
+            const quint64 sequence = event.sequence.load(std::memory_order_acquire);
+            const char* const name = event.name.load(std::memory_order_relaxed);
+            const qint64 timestamp = event.timestamp.load(std::memory_order_relaxed);
+            const char phase = event.phase.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (sequence != 2 * (position + 1) or
+                event.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+
+            QJsonObject object;
+            object[QStringLiteral("name")] = QString::fromLatin1(name);
+            object[QStringLiteral("ph")] = QString(QLatin1Char(phase));
+            object[QStringLiteral("ts")] = timestamp / 1000.0;
+            object[QStringLiteral("pid")] = processId;
+            object[QStringLiteral("tid")] = buffer->threadId;
+            events->append(object);
+        }
+    }
+
+} // anonymous namespace
+
+void Trace::setEnabled(const bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Trace::begin(const char* name)
+{
+    Record(name, PHASE_BEGIN);
+}
+
+void Trace::end(const char* name)
+{
+    Record(name, PHASE_END);
+}
+
+QByteArray Trace::chromeTrace()
+{
+    const qint64 processId = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    Registry& registry = GetRegistry();
+    QMutexLocker locker(&registry.mutex);
+    for (ThreadBuffer* const buffer : registry.buffers) {
+        ExportBuffer(buffer, processId, &events);
+    }
+    locker.unlock();
+
+    QJsonObject document;
+    document[QStringLiteral("traceEvents")] = events;
+    document[QStringLiteral("displayTimeUnit")] = QStringLiteral("ns");
+    return QJsonDocument(document).toJson(QJsonDocument::Compact);
+}
+
+bool Trace::writeChromeTrace(const QString& fileName)
+{
+    QSaveFile file(fileName);
+    if (not file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    const QByteArray data = chromeTrace();
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+void Trace::clear()
+{
+    Registry& registry = GetRegistry();
+    QMutexLocker locker(&registry.mutex);
+    for (ThreadBuffer* const buffer : registry.buffers) {
+        ResetBuffer(buffer);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+#include <atomic>
+
+/*
+  Binary event tracing of the request wrappers.
+  Every thread writes begin and end events into its own fixed size ring buffer without
+  locks, the oldest events are overwritten when the buffer is full. Event names must be
+  string literals (or Q_FUNC_INFO), only the pointer is stored.
+  Disabled by default, a disabled event costs one relaxed atomic load. Defining
+  CRYPTOS_NO_TRACING compiles all events out.
+  Collected events are exported in the Chrome trace event format which is opened by
+  chrome://tracing and ui.perfetto.dev.
+ */
+class Trace : public QObject {
+    Q_OBJECT
+
+public:
+    static const int RingBufferSize = 16 * 1024;
+
+    static void setEnabled(const bool enabled);
+
+    static bool isEnabled()
+    {
+#ifdef CRYPTOS_NO_TRACING
+        return false;
+#else
+        return s_enabled.load(std::memory_order_relaxed);
+#endif
+    }
+
+    static void begin(const char* name);
+    static void end(const char* name);
+
+    /*
+      Events of all threads as a Chrome trace JSON document. Events which are overwritten
+      while exporting are skipped, so it is safe to export during tracing.
+     */
+    static QByteArray chromeTrace();
+    static bool writeChromeTrace(const QString& fileName);
+
+    /*
+      Drops all collected events. Must not be called while other threads are tracing.
+     */
+    static void clear();
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+/*
+  Traces a wrapper call as one event and its consecutive phases as nested events.
+  phase() ends the previous phase and begins the next one, the last phase and the call
+  itself end when the scope is left.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : m_name(Trace::isEnabled() ? name : nullptr)
+        , m_phase(nullptr)
+    {
+        if (m_name) {
+            Trace::begin(m_name);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_name) {
+            if (m_phase) {
+                Trace::end(m_phase);
+            }
+            Trace::end(m_name);
+        }
+    }
+
+    void phase(const char* name)
+    {
+        if (m_name) {
+            if (m_phase) {
+                Trace::end(m_phase);
+            }
+            m_phase = name;
+            Trace::begin(m_phase);
+        }
+    }
+
+private:
+    const char* const m_name;
+    const char* m_phase;
+};
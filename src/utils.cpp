@@ -4,6 +4,7 @@
 #include <Sailfish/Secrets/request.h>
 
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 
 bool IsRequestWasSuccessful(Sailfish::Crypto::Request* request)
 {
@@ -36,3 +37,24 @@ bool IsRequestWasSuccessful(Sailfish::Secrets::Request* request)
         request->status() == Sailfish::Secrets::Request::Finished and
         request->result().code() == Sailfish::Secrets::Result::Succeeded;
 }
+
+bool IsResultWasSuccessful(const Sailfish::Crypto::Result& result)
+{
+    if (result.code() != Sailfish::Crypto::Result::Succeeded) {
+        qDebug() << "\n\n";
+        qDebug() << result.code();
+        qDebug() << result.errorMessage();
+    }
+
+    return result.code() == Sailfish::Crypto::Result::Succeeded;
+}
+
+qint64 MonotonicMilliseconds()
+{
+    static const QElapsedTimer timer = [] () {
+        QElapsedTimer started;
+        started.start();
+        return started;
+    }();
+    return timer.elapsed();
+}
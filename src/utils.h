@@ -1,8 +1,11 @@
 #pragma once
 
+#include <QtCore/QtGlobal>
+
 namespace Sailfish {
     namespace Crypto {
         class Request;
+        class Result;
     }
     namespace Secrets {
         class Request;
@@ -11,3 +14,10 @@ namespace Sailfish {
 
 bool IsRequestWasSuccessful(Sailfish::Crypto::Request* request);
 bool IsRequestWasSuccessful(Sailfish::Secrets::Request* request);
+bool IsResultWasSuccessful(const Sailfish::Crypto::Result& result);
+
+/*
+  Milliseconds of a monotonic clock which is started on the first call,
+  for time to live checks.
+ */
+qint64 MonotonicMilliseconds();